@@ -0,0 +1,363 @@
+#include "nbt_interface.hpp"
+#include "nbt_diff.hpp"
+#include "nbt_codec.hpp"
+#include "nbt_writer.hpp"
+#include "nbt_block_index.hpp"
+#include "nbt_parallel.hpp"
+#include <iostream>
+#include <string>
+#include <cstdio>
+
+/* Usage: dhnbt_interface_bench <file.nbt> */
+
+/* Touch every `step`-th integer tag, like a handful of block edits */
+static int edit_integers(NBT* node, int step, int& counter)
+{
+    int edited = 0;
+    for(; node ; node = node->next)
+    {
+        if(node->type >= TAG_Byte && node->type <= TAG_Long)
+        {
+            if(++counter % step == 0)
+            {
+                node->value_i ^= 1;
+                edited++;
+            }
+        }
+        else if(node->type == TAG_List || node->type == TAG_Compound)
+            edited += edit_integers(node->child, step, counter);
+    }
+    return edited;
+}
+
+static void bench_diff(const char* filename)
+{
+    DhNbtInstance original(filename);
+    if(!original.is_non_null())
+    {
+        std::cout << "Can't load " << filename << "\n";
+        return;
+    }
+    DhNbtInstance edited = original.dup_current_as_original(false);
+    int counter = 0;
+    int edits = edit_integers(edited.get_current_nbt()->child, 997, counter);
+
+    gint64 start = g_get_monotonic_time();
+    DhNbtPatch patch = DhNbtPatch::diff(original, edited);
+    auto data = patch.serialize();
+    gint64 diff_time = g_get_monotonic_time() - start;
+
+    DhNbtInstance replica = original.dup_current_as_original(false);
+    start = g_get_monotonic_time();
+    DhNbtPatch received = DhNbtPatch::deserialize(data.data(), data.size());
+    bool applied = received.apply(replica);
+    gint64 apply_time = g_get_monotonic_time() - start;
+
+    start = g_get_monotonic_time();
+    edited.save_to_file("bench_full.nbt");
+    gint64 save_time = g_get_monotonic_time() - start;
+    gsize full_len = 0;
+    gchar* full = nullptr;
+    if(g_file_get_contents("bench_full.nbt", &full, &full_len, nullptr))
+        g_free(full);
+
+    std::cout << "diff: " << edits << " edits, " << patch.get_ops().size() << " ops\n"
+              << "  patch size " << data.size() << " B, full file " << full_len << " B\n"
+              << "  diff " << diff_time << " us, apply " << apply_time << " us ("
+              << (applied ? "ok" : "failed") << "), full save " << save_time << " us\n";
+}
+
+static void bench_compression(const char* filename)
+{
+    DhNbtInstance root(filename);
+    if(!root.is_non_null()) return;
+    std::vector<guint8> raw;
+    dh_nbt_write_node(root.get_original_nbt(), true, raw);
+
+    const DhNbtCompression types[] = { DH_COMPRESSION_NONE, DH_COMPRESSION_GZIP,
+                                       DH_COMPRESSION_ZLIB, DH_COMPRESSION_ZSTD };
+    const char* names[] = { "none", "gzip", "zlib", "zstd" };
+    const int rounds = 10;
+    std::cout << "compression of " << raw.size() << " raw bytes:\n";
+    for(int i = 0 ; i < 4 ; i++)
+    {
+        if(!dh_nbt_compression_available(types[i]))
+        {
+            std::cout << "  " << names[i] << ": no backend\n";
+            continue;
+        }
+        std::vector<guint8> packed;
+        std::vector<guint8> unpacked;
+        gint64 start = g_get_monotonic_time();
+        for(int j = 0 ; j < rounds ; j++)
+            dh_nbt_compress(raw.data(), raw.size(), types[i], packed);
+        gint64 pack_time = g_get_monotonic_time() - start + 1;
+        start = g_get_monotonic_time();
+        for(int j = 0 ; j < rounds ; j++)
+            dh_nbt_decompress(packed.data(), packed.size(), DH_COMPRESSION_AUTO, unpacked);
+        gint64 unpack_time = g_get_monotonic_time() - start + 1;
+        double mb = (double)raw.size() * rounds;
+        std::cout << "  " << names[i] << " (" << dh_nbt_compression_backend(types[i]) << "): ratio "
+                  << (double)packed.size() / raw.size() << ", compress " << mb / pack_time
+                  << " MB/s, decompress " << mb / unpack_time << " MB/s"
+                  << (unpacked == raw ? "" : " (MISMATCH)") << "\n";
+    }
+}
+
+static void bench_atomic_save(const char* filename)
+{
+    DhNbtInstance root(filename);
+    if(!root.is_non_null()) return;
+    const int files = 8;
+    std::string names[files];
+    for(int i = 0 ; i < files ; i++)
+        names[i] = "bench_atomic_" + std::to_string(i) + ".nbt";
+
+    gint64 start = g_get_monotonic_time();
+    for(int i = 0 ; i < files ; i++)
+        root.save_to_file_atomic(names[i].c_str(), DH_COMPRESSION_GZIP, DH_FSYNC_DATA);
+    gint64 single_time = g_get_monotonic_time() - start;
+
+    start = g_get_monotonic_time();
+    DhNbtSaveBatch batch(DH_FSYNC_DATA);
+    for(int i = 0 ; i < files ; i++)
+        batch.add(root, names[i].c_str(), DH_COMPRESSION_GZIP);
+    bool ret = batch.commit();
+    gint64 batch_time = g_get_monotonic_time() - start;
+
+    std::cout << "atomic save of " << files << " files: " << single_time << " us one by one, "
+              << batch_time << " us batched (" << (ret ? "ok" : "failed") << ")\n";
+    for(int i = 0 ; i < files ; i++)
+        remove(names[i].c_str());
+}
+
+/* Generated output, nothing is kept in memory */
+static void bench_writer()
+{
+    const int entries = 1 << 20;
+    gint64 start = g_get_monotonic_time();
+    DhNbtWriter writer("bench_writer.nbt", DH_COMPRESSION_GZIP);
+    writer.begin_compound();
+    writer.begin_list(DH_TYPE_Compound, entries, "entries");
+    for(int i = 0 ; i < entries ; i++)
+    {
+        gint32 pos[3] = { i & 0xff, i >> 16, (i >> 8) & 0xff };
+        writer.begin_compound();
+        writer.write_int(i, "id");
+        writer.write_string("minecraft:stone", "name");
+        writer.write_int_array(pos, 3, "pos");
+        writer.end();
+    }
+    writer.end();
+    writer.end();
+    bool ret = writer.finish();
+    gint64 time = g_get_monotonic_time() - start;
+
+    long size = 0;
+    FILE* file = fopen("bench_writer.nbt", "rb");
+    if(file)
+    {
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fclose(file);
+    }
+    std::cout << "streaming writer: " << entries << " compounds in " << time << " us, "
+              << size << " bytes gzip (" << (ret ? "ok" : "failed") << ")\n";
+    remove("bench_writer.nbt");
+}
+
+static void bench_block_index(const char* filename)
+{
+    DhNbtInstance root(filename);
+    if(!root.is_non_null()) return;
+    DhNbtBlockIndex index;
+    gint64 start = g_get_monotonic_time();
+    bool ret = index.build(root, 1);
+    gint64 single_time = g_get_monotonic_time() - start;
+    start = g_get_monotonic_time();
+    index.build(root);
+    gint64 parallel_time = g_get_monotonic_time() - start;
+    int min[3], max[3];
+    if(!ret || !index.get_bounds(min, max))
+    {
+        std::cout << "block index: not a structure or litematic\n";
+        return;
+    }
+
+    const int queries = 1 << 22;
+    guint32 seed = 1;
+    gint64 found = 0;
+    start = g_get_monotonic_time();
+    for(int i = 0 ; i < queries ; i++)
+    {
+        int pos[3];
+        for(int j = 0 ; j < 3 ; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            pos[j] = min[j] + (int)((seed >> 8) % (guint32)(max[j] - min[j] + 1));
+        }
+        found += index.get_state(pos[0], pos[1], pos[2]) >= 0;
+    }
+    gint64 query_time = g_get_monotonic_time() - start;
+
+    gint64 blocks = 0;
+    start = g_get_monotonic_time();
+    index.for_each_in_box(min, max, [&](int, int, int, int) { blocks++; });
+    gint64 box_time = g_get_monotonic_time() - start;
+
+    std::cout << "block index: build " << single_time << " us on one thread, " << parallel_time
+              << " us in parallel, " << index.palette_size() << " states\n"
+              << "  " << queries << " point queries in " << query_time << " us (" << found << " blocks), "
+              << blocks << " blocks iterated in " << box_time << " us\n";
+}
+
+/* Tags counted by type, from one thread to all of them */
+static void bench_parallel(const char* filename)
+{
+    DhNbtInstance root(filename);
+    if(!root.is_non_null()) return;
+    struct Counts
+    {
+        gint64 types[DH_TYPE_Long_Array] = { 0 };
+    };
+    auto map = [](NBT* node, Counts& acc) { acc.types[node->type]++; };
+    auto reduce = [](Counts& total, Counts& acc) {
+        for(int i = 0 ; i < DH_TYPE_Long_Array ; i++)
+            total.types[i] += acc.types[i];
+    };
+
+    const int rounds = 20;
+    int max_threads = g_get_num_processors();
+    gint64 base = 0;
+    std::cout << "parallel map/reduce, " << rounds << " rounds:\n";
+    for(int threads = 1 ; ; threads = MIN(threads * 2, max_threads))
+    {
+        gint64 nodes = 0;
+        gint64 start = g_get_monotonic_time();
+        for(int i = 0 ; i < rounds ; i++)
+        {
+            Counts counts = dh_nbt_map_reduce(root, Counts(), map, reduce, threads);
+            for(gint64 count : counts.types)
+                nodes += count;
+        }
+        gint64 time = g_get_monotonic_time() - start;
+        if(threads == 1) base = time;
+        std::cout << "  " << threads << " threads: " << time << " us, " << nodes / rounds << " nodes, speedup "
+                  << (double)base / MAX(time, 1) << "\n";
+        if(threads == max_threads) break;
+    }
+}
+
+static guint64 count_nodes(NBT* node)
+{
+    guint64 ret = 1;
+    if(node->type == TAG_List || node->type == TAG_Compound)
+        for(NBT* child = node->child ; child ; child = child->next)
+            ret += count_nodes(child);
+    return ret;
+}
+
+/* Every grandchild of the root frozen, as for cold chunk sections. The
+ * pack goes through the blobs, the thaw is what child() would pay over
+ * the whole tree. */
+static void bench_freeze(const char* filename)
+{
+    DhNbtCompression types[] = { DH_COMPRESSION_NONE, DH_COMPRESSION_ZSTD };
+    const char* names[] = { "raw", "zstd" };
+    for(int i = 0 ; i < 2 ; i++)
+    {
+        if(!dh_nbt_compression_available(types[i])) continue;
+        DhNbtInstance root(filename);
+        if(!root.is_non_null()) return;
+        guint64 nodes = count_nodes(root.get_original_nbt());
+        int frozen = 0;
+        gint64 start = g_get_monotonic_time();
+        DhNbtInstance child(root);
+        if(child.child())
+            for(; child.is_non_null() ; child.next())
+            {
+                DhNbtInstance node(child);
+                if(!node.child()) continue;
+                for(; node.is_non_null() ; node.next())
+                    frozen += node.freeze(types[i]);
+            }
+        gint64 freeze_time = g_get_monotonic_time() - start;
+        guint64 resident = count_nodes(root.get_original_nbt());
+
+        std::vector<guint8> out;
+        start = g_get_monotonic_time();
+        root.pack(out, DH_COMPRESSION_NONE);
+        gint64 pack_time = g_get_monotonic_time() - start;
+        DhNbtFreezeStats stats = root.get_freeze_stats();
+
+        start = g_get_monotonic_time();
+        gsize thawed = root.thaw_all();
+        gint64 thaw_time = g_get_monotonic_time() - start;
+        std::cout << "freeze (" << names[i] << "): " << frozen << " subtrees in " << freeze_time << " us, "
+                  << resident << " of " << nodes << " nodes resident, "
+                  << stats.saved_bytes << " bytes saved, " << stats.blob_bytes << " in blobs, pack "
+                  << pack_time << " us, thaw " << thawed << " in " << thaw_time << " us\n";
+    }
+}
+
+/* Reopening a file, without then with its sidecar */
+static void bench_sidecar(const char* filename)
+{
+    const int rounds = 10;
+    DhNbtSidecarMode modes[] = { DH_SIDECAR_OFF, DH_SIDECAR_STAT, DH_SIDECAR_HASH };
+    const char* names[] = { "off", "stat", "hash" };
+    std::cout << "sidecar reopen, " << rounds << " rounds:\n";
+    for(int i = 0 ; i < 3 ; i++)
+    {
+        dh_nbt_sidecar_set_mode(modes[i], NULL);
+        /* Cold load, writes the sidecar */
+        gint64 start = g_get_monotonic_time();
+        {
+            DhNbtInstance root(filename);
+            if(!root.is_non_null()) break;
+        }
+        dh_nbt_sidecar_wait();
+        gint64 cold_time = g_get_monotonic_time() - start;
+
+        start = g_get_monotonic_time();
+        for(int j = 0 ; j < rounds ; j++)
+            DhNbtInstance root(filename);
+        gint64 warm_time = g_get_monotonic_time() - start;
+        std::cout << "  " << names[i] << ": cold " << cold_time << " us, warm "
+                  << warm_time / rounds << " us\n";
+    }
+    dh_nbt_sidecar_set_mode(DH_SIDECAR_OFF, NULL);
+}
+
+static void print_stats()
+{
+    DhNbtStats stats = dh_nbt_stats_collect();
+    std::cout << "stats (zero unless built with NIMM_ENABLE_STATS):\n"
+              << "  nodes " << stats.nodes_allocated << " allocated, " << stats.nodes_freed << " freed, "
+              << stats.strdup_bytes << " strdup bytes\n"
+              << "  " << stats.key_comparisons << " key comparisons, " << stats.tree_pushes << " tree pushes, "
+              << stats.pack_retries << " pack retries\n"
+              << "  bytes " << stats.bytes_read << " read, " << stats.bytes_decompressed << " decompressed, "
+              << stats.bytes_written << " written\n"
+              << "  " << stats.load_calls << " loads in " << stats.load_time_us << " us, "
+              << stats.save_calls << " saves in " << stats.save_time_us << " us\n";
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <file.nbt>\n";
+        return 1;
+    }
+    bench_diff(argv[1]);
+    bench_compression(argv[1]);
+    bench_atomic_save(argv[1]);
+    bench_writer();
+    bench_block_index(argv[1]);
+    bench_parallel(argv[1]);
+    bench_freeze(argv[1]);
+    bench_sidecar(argv[1]);
+    print_stats();
+    return 0;
+}
@@ -0,0 +1,681 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_block_index.hpp"
+#include "nbt_parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+
+/* What one thread decodes, merged into the index afterwards */
+struct DhNbtBlockIndex::Decoded
+{
+    struct Block
+    {
+        int pos[3];
+        int state;
+        NBT* node;
+    };
+    bool ok = true;
+    /* Parents of the region or of the block entries, from the root */
+    std::vector<NBT*> path;
+    /* Litematic region: a dense box of local palette indices */
+    std::string name;
+    Box box;
+    std::vector<DhNbtBlockState> palette;
+    std::vector<guint32> cells;
+    /* Part of a structure block list, with our palette indices */
+    std::vector<Block> blocks;
+    std::vector<std::pair<guint64, Entity>> entities;
+};
+
+static NBT* find_child(NBT* node, const char* key)
+{
+    if(!node || node->type != TAG_Compound) return nullptr;
+    for(NBT* child = node->child ; child ; child = child->next)
+        if(child->key && strcmp(child->key, key) == 0) return child;
+    return nullptr;
+}
+
+static bool get_int(NBT* node, const char* key, int& val)
+{
+    NBT* child = find_child(node, key);
+    if(!child || child->type < TAG_Byte || child->type > TAG_Long) return false;
+    val = child->value_i;
+    return true;
+}
+
+/* Structure position: a list of three integers */
+static bool get_pos_list(NBT* node, int pos[3])
+{
+    if(!node || node->type != TAG_List) return false;
+    NBT* child = node->child;
+    for(int i = 0 ; i < 3 ; i++, child = child->next)
+    {
+        if(!child || child->type < TAG_Byte || child->type > TAG_Long) return false;
+        pos[i] = child->value_i;
+    }
+    return true;
+}
+
+/* Litematic position: a compound with x, y and z */
+static bool get_pos_compound(NBT* node, int pos[3])
+{
+    return get_int(node, "x", pos[0]) && get_int(node, "y", pos[1]) && get_int(node, "z", pos[2]);
+}
+
+static bool read_state(NBT* entry, DhNbtBlockState& state)
+{
+    NBT* name = find_child(entry, "Name");
+    if(!name || name->type != TAG_String) return false;
+    state.name = (const char*)name->value_a.value;
+    state.properties.clear();
+
+    NBT* properties = find_child(entry, "Properties");
+    if(!properties) return true;
+    std::vector<std::string> pairs;
+    for(NBT* child = properties->child ; child ; child = child->next)
+        if(child->key && child->type == TAG_String)
+            pairs.push_back(std::string(child->key) + "=" + (const char*)child->value_a.value);
+    std::sort(pairs.begin(), pairs.end());
+    for(auto& pair : pairs)
+    {
+        if(!state.properties.empty()) state.properties += ",";
+        state.properties += pair;
+    }
+    return true;
+}
+
+static bool box_contains(const int min[3], const int max[3], const int pos[3])
+{
+    for(int i = 0 ; i < 3 ; i++)
+        if(pos[i] < min[i] || pos[i] > max[i]) return false;
+    return true;
+}
+
+/* Grow the box, which is unset if !has_box, to hold [min, max] */
+static void box_extend(int box_min[3], int box_max[3], bool& has_box, const int min[3], const int max[3])
+{
+    for(int i = 0 ; i < 3 ; i++)
+    {
+        if(!has_box || min[i] < box_min[i]) box_min[i] = min[i];
+        if(!has_box || max[i] > box_max[i]) box_max[i] = max[i];
+    }
+    has_box = true;
+}
+
+/* `func(i)` for i in [0, count) on up to `threads` threads */
+static void run_parallel(int count, int threads, const std::function<void(int)>& func)
+{
+    if(threads <= 0) threads = g_get_num_processors();
+    threads = MIN(threads, count);
+    if(threads <= 1)
+    {
+        for(int i = 0 ; i < count ; i++)
+            func(i);
+        return;
+    }
+    std::atomic<int> next(0);
+    dh_nbt_parallel_run(threads, [&](int) {
+        for(int task = next++ ; task < count ; task = next++)
+            func(task);
+    });
+}
+
+DhNbtBlockIndex::DhNbtBlockIndex()
+{
+    has_bounds = false;
+    bounds_dirty = false;
+    litematic = false;
+    valid = false;
+}
+
+/* Packed positions have 21 bits per axis */
+static bool pos_in_range(const int pos[3])
+{
+    for(int i = 0 ; i < 3 ; i++)
+        if(pos[i] < -(1 << 20) || pos[i] >= (1 << 20)) return false;
+    return true;
+}
+
+guint64 DhNbtBlockIndex::pack_pos(int x, int y, int z)
+{
+    return ((guint64)(x & 0x1fffff) << 42) | ((guint64)(y & 0x1fffff) << 21) | (guint64)(z & 0x1fffff);
+}
+
+void DhNbtBlockIndex::unpack_pos(guint64 packed, int pos[3])
+{
+    for(int i = 0 ; i < 3 ; i++)
+    {
+        /* Sign-extend the 21 bit fields back */
+        gint64 field = (packed >> (42 - 21 * i)) & 0x1fffff;
+        pos[i] = (field ^ 0x100000) - 0x100000;
+    }
+}
+
+DhNbtBlockIndex::Section* DhNbtBlockIndex::find_section(int x, int y, int z)
+{
+    auto it = sections.find(pack_pos(x >> 4, y >> 4, z >> 4));
+    return it == sections.end() ? nullptr : it->second.get();
+}
+
+DhNbtBlockIndex::Section* DhNbtBlockIndex::get_section(int x, int y, int z)
+{
+    auto& section = sections[pack_pos(x >> 4, y >> 4, z >> 4)];
+    if(!section)
+    {
+        section.reset(new Section);
+        memset(section->cells, 0, sizeof(section->cells));
+    }
+    return section.get();
+}
+
+int DhNbtBlockIndex::intern(const std::string& name, const std::string& properties)
+{
+    std::string key = name + "[" + properties + "]";
+    auto it = palette_map.find(key);
+    if(it != palette_map.end()) return it->second;
+    /* A cell holds state + 1 in 16 bits */
+    if(palette.size() >= 0xffff) return -1;
+    palette.push_back({ name, properties });
+    palette_map[key] = palette.size() - 1;
+    return palette.size() - 1;
+}
+
+int DhNbtBlockIndex::add_state(const char* name, const char* properties)
+{
+    return intern(name, properties ? properties : "");
+}
+
+/* Our palette index for a structure one, the palette may have grown */
+int DhNbtBlockIndex::structure_state(int local)
+{
+    if(local < 0) return -1;
+    if(local >= (int)structure_palette.size())
+    {
+        NBT* list = find_child(root.get_original_nbt(), "palette");
+        if(!list)
+        {
+            list = find_child(root.get_original_nbt(), "palettes");
+            list = list ? list->child : nullptr;
+        }
+        int i = 0;
+        for(NBT* entry = list ? list->child : nullptr ; entry ; entry = entry->next, i++)
+        {
+            if(i < (int)structure_palette.size()) continue;
+            DhNbtBlockState state;
+            structure_palette.push_back(read_state(entry, state) ? intern(state.name, state.properties) : -1);
+        }
+    }
+    return local < (int)structure_palette.size() ? structure_palette[local] : -1;
+}
+
+bool DhNbtBlockIndex::set_block(int x, int y, int z, int state)
+{
+    int pos[3] = { x, y, z };
+    if(state >= (int)palette.size() || !pos_in_range(pos)) return false;
+    if(state < 0)
+    {
+        Section* section = find_section(x, y, z);
+        if(!section) return true;
+        guint16& cell = section->cells[((y & 15) << 8) | ((z & 15) << 4) | (x & 15)];
+        if(cell) bounds_dirty = true;
+        cell = 0;
+        return true;
+    }
+    get_section(x, y, z)->cells[((y & 15) << 8) | ((z & 15) << 4) | (x & 15)] = state + 1;
+    box_extend(bounds.min, bounds.max, has_bounds, pos, pos);
+    return true;
+}
+
+int DhNbtBlockIndex::get_state(int x, int y, int z)
+{
+    int pos[3] = { x, y, z };
+    Section* section = pos_in_range(pos) ? find_section(x, y, z) : nullptr;
+    if(!section) return -1;
+    return section->cells[((y & 15) << 8) | ((z & 15) << 4) | (x & 15)] - 1;
+}
+
+const DhNbtBlockState* DhNbtBlockIndex::get_block(int x, int y, int z)
+{
+    int state = get_state(x, y, z);
+    return state < 0 ? nullptr : &palette[state];
+}
+
+/* Shrinking needs the whole index, so it is only done when asked for */
+void DhNbtBlockIndex::update_bounds()
+{
+    has_bounds = false;
+    bounds_dirty = false;
+    for(auto& it : sections)
+    {
+        int base[3];
+        unpack_pos(it.first, base);
+        const guint16* cells = it.second->cells;
+        for(int i = 0 ; i < 4096 ; i++)
+        {
+            if(!cells[i]) continue;
+            int pos[3] = { base[0] * 16 + (i & 15), base[1] * 16 + (i >> 8), base[2] * 16 + ((i >> 4) & 15) };
+            box_extend(bounds.min, bounds.max, has_bounds, pos, pos);
+        }
+    }
+}
+
+bool DhNbtBlockIndex::get_bounds(int min[3], int max[3])
+{
+    if(bounds_dirty) update_bounds();
+    if(!has_bounds) return false;
+    for(int i = 0 ; i < 3 ; i++)
+    {
+        min[i] = bounds.min[i];
+        max[i] = bounds.max[i];
+    }
+    return true;
+}
+
+bool DhNbtBlockIndex::get_block_entity(int x, int y, int z, DhNbtInstance& out)
+{
+    int pos[3] = { x, y, z };
+    auto it = pos_in_range(pos) ? block_entities.find(pack_pos(x, y, z)) : block_entities.end();
+    if(it == block_entities.end()) return false;
+    out = root;
+    out.set_tree_struct(it->second.path);
+    out.set_current_nbt(it->second.node);
+    return true;
+}
+
+void DhNbtBlockIndex::set_block_entity(int x, int y, int z, DhNbtInstance& node)
+{
+    int pos[3] = { x, y, z };
+    if(node.is_non_null() && pos_in_range(pos))
+        block_entities[pack_pos(x, y, z)] = { node.get_current_nbt(), node.get_tree_struct() };
+}
+
+void DhNbtBlockIndex::remove_block_entity(int x, int y, int z)
+{
+    block_entities.erase(pack_pos(x, y, z));
+}
+
+/* Litematic BlockStates: entries of `bits` bits, which may span two longs */
+void DhNbtBlockIndex::decode_region(NBT* region, Decoded& out)
+{
+    int pos[3], size[3];
+    out.ok = false;
+    if(!get_pos_compound(find_child(region, "Position"), pos)
+       || !get_pos_compound(find_child(region, "Size"), size))
+        return;
+    gsize volume = 1;
+    for(int i = 0 ; i < 3 ; i++)
+    {
+        if(size[i] == 0) return;
+        out.box.min[i] = pos[i] + (size[i] < 0 ? size[i] + 1 : 0);
+        out.box.max[i] = out.box.min[i] + ABS(size[i]) - 1;
+        volume *= ABS(size[i]);
+    }
+    if(!pos_in_range(out.box.min) || !pos_in_range(out.box.max)) return;
+
+    NBT* list = find_child(region, "BlockStatePalette");
+    for(NBT* entry = list ? list->child : nullptr ; entry ; entry = entry->next)
+    {
+        DhNbtBlockState state;
+        if(!read_state(entry, state)) return;
+        out.palette.push_back(state);
+    }
+    NBT* states = find_child(region, "BlockStates");
+    if(out.palette.empty() || !states || states->type != TAG_Long_Array) return;
+
+    int bits = 2;
+    while(((gsize)1 << bits) < out.palette.size())
+        bits++;
+    const guint64* data = (const guint64*)states->value_a.value;
+    if((gsize)states->value_a.len * 64 < volume * bits) return;
+
+    guint64 mask = ((guint64)1 << bits) - 1;
+    out.cells.resize(volume);
+    for(gsize i = 0 ; i < volume ; i++)
+    {
+        gsize start = i * bits;
+        gsize word = start >> 6;
+        int offset = start & 63;
+        guint64 val = data[word] >> offset;
+        if(offset + bits > 64)
+            val |= data[word + 1] << (64 - offset);
+        val &= mask;
+        if(val >= out.palette.size()) return;
+        out.cells[i] = val;
+    }
+
+    /* Tile entity positions are relative to the region corner */
+    list = find_child(region, "TileEntities");
+    std::vector<NBT*> path = out.path;
+    path.push_back(region);
+    path.push_back(list);
+    for(NBT* entry = list ? list->child : nullptr ; entry ; entry = entry->next)
+    {
+        int rel[3];
+        if(get_pos_compound(entry, rel))
+            out.entities.push_back({ pack_pos(out.box.min[0] + rel[0], out.box.min[1] + rel[1],
+                                              out.box.min[2] + rel[2]), { entry, path } });
+    }
+    out.ok = true;
+}
+
+/* Entries of a structure `blocks` list; structure_palette has to be
+ * filled beforehand as it is only read here */
+void DhNbtBlockIndex::decode_blocks(NBT** blocks, int n, Decoded& out)
+{
+    out.blocks.reserve(n);
+    for(int i = 0 ; i < n ; i++)
+    {
+        Decoded::Block block;
+        int local = -1;
+        if(!get_pos_list(find_child(blocks[i], "pos"), block.pos) || !pos_in_range(block.pos)
+           || !get_int(blocks[i], "state", local) || local < 0 || local >= (int)structure_palette.size() || structure_palette[local] < 0)
+        {
+            out.ok = false;
+            continue;
+        }
+        block.state = structure_palette[local];
+        block.node = blocks[i];
+        out.blocks.push_back(block);
+        NBT* entity = find_child(blocks[i], "nbt");
+        if(!entity) continue;
+        std::vector<NBT*> path = out.path;
+        path.push_back(blocks[i]);
+        out.entities.push_back({ pack_pos(block.pos[0], block.pos[1], block.pos[2]), { entity, path } });
+    }
+}
+
+void DhNbtBlockIndex::merge(Decoded& decoded, const Box* area)
+{
+    for(auto& block : decoded.blocks)
+    {
+        set_block(block.pos[0], block.pos[1], block.pos[2], block.state);
+        entry_positions[block.node] = pack_pos(block.pos[0], block.pos[1], block.pos[2]);
+    }
+
+    if(!decoded.cells.empty())
+    {
+        std::vector<int> states;
+        for(auto& state : decoded.palette)
+            states.push_back(intern(state.name, state.properties));
+        const Box& box = decoded.box;
+        Box part = box;
+        bool empty = false;
+        for(int i = 0 ; area && i < 3 ; i++)
+        {
+            part.min[i] = MAX(box.min[i], area->min[i]);
+            part.max[i] = MIN(box.max[i], area->max[i]);
+            if(part.min[i] > part.max[i]) empty = true;
+        }
+        gsize size_x = box.max[0] - box.min[0] + 1;
+        gsize size_z = box.max[2] - box.min[2] + 1;
+        /* Rows along x, one section lookup per 16 cells */
+        for(int y = part.min[1] ; !empty && y <= part.max[1] ; y++)
+            for(int z = part.min[2] ; z <= part.max[2] ; z++)
+            {
+                const guint32* cell = decoded.cells.data()
+                                      + ((y - box.min[1]) * size_z + (z - box.min[2])) * size_x
+                                      + (part.min[0] - box.min[0]);
+                for(int x = part.min[0] ; x <= part.max[0] ; )
+                {
+                    Section* section = get_section(x, y, z);
+                    guint16* row = section->cells + (((y & 15) << 8) | ((z & 15) << 4));
+                    int end = MIN(part.max[0], (x | 15));
+                    for( ; x <= end ; x++, cell++)
+                        row[x & 15] = states[*cell] < 0 ? 0 : states[*cell] + 1;
+                }
+            }
+        if(!area)
+        {
+            box_extend(bounds.min, bounds.max, has_bounds, box.min, box.max);
+            regions[decoded.name] = box;
+        }
+    }
+
+    for(auto& entity : decoded.entities)
+    {
+        int pos[3];
+        unpack_pos(entity.first, pos);
+        if(!area || box_contains(area->min, area->max, pos))
+            block_entities[entity.first] = entity.second;
+    }
+}
+
+bool DhNbtBlockIndex::build(DhNbtInstance& root, int threads)
+{
+    sections.clear();
+    palette.clear();
+    palette_map.clear();
+    block_entities.clear();
+    entry_positions.clear();
+    structure_palette.clear();
+    regions.clear();
+    has_bounds = false;
+    bounds_dirty = false;
+    valid = false;
+
+    this->root = root;
+    this->root.goto_root();
+    NBT* node = this->root.get_original_nbt();
+    if(!node) return false;
+    /* The decoders walk the nodes directly */
+    this->root.thaw_all();
+
+    NBT* list = find_child(node, "Regions");
+    if(list && list->type == TAG_Compound)
+    {
+        litematic = true;
+        std::vector<NBT*> nodes;
+        for(NBT* region = list->child ; region ; region = region->next)
+            nodes.push_back(region);
+        std::vector<Decoded> decoded(nodes.size());
+        run_parallel(nodes.size(), threads, [&](int i) {
+            decoded[i].name = nodes[i]->key ? nodes[i]->key : "";
+            decoded[i].path = { node, list };
+            decode_region(nodes[i], decoded[i]);
+        });
+        valid = true;
+        for(auto& region : decoded)
+        {
+            if(!region.ok) valid = false;
+            else merge(region);
+        }
+        return valid;
+    }
+
+    list = find_child(node, "blocks");
+    if(!list || list->type != TAG_List) return false;
+    litematic = false;
+    structure_state(G_MAXINT);
+    std::vector<NBT*> nodes;
+    for(NBT* block = list->child ; block ; block = block->next)
+        nodes.push_back(block);
+
+    /* Enough blocks per part to be worth a thread */
+    const int part_size = 1 << 14;
+    int parts = (nodes.size() + part_size - 1) / part_size;
+    std::vector<Decoded> decoded(parts);
+    entry_positions.reserve(nodes.size());
+    run_parallel(parts, threads, [&](int i) {
+        int start = i * part_size;
+        decoded[i].path = { node, list };
+        decode_blocks(nodes.data() + start, MIN(part_size, (int)nodes.size() - start), decoded[i]);
+    });
+    valid = true;
+    for(auto& part : decoded)
+    {
+        if(!part.ok) valid = false;
+        merge(part);
+    }
+    return valid;
+}
+
+/* Sections are walked as in for_each_in_box(), one lookup each */
+void DhNbtBlockIndex::clear_box(const Box& box)
+{
+    const int* min = box.min;
+    const int* max = box.max;
+    for(int sy = min[1] >> 4 ; sy <= max[1] >> 4 ; sy++)
+        for(int sz = min[2] >> 4 ; sz <= max[2] >> 4 ; sz++)
+            for(int sx = min[0] >> 4 ; sx <= max[0] >> 4 ; sx++)
+            {
+                Section* section = find_section(sx * 16, sy * 16, sz * 16);
+                if(!section) continue;
+                int y0 = MAX(min[1], sy * 16), y1 = MIN(max[1], sy * 16 + 15);
+                int z0 = MAX(min[2], sz * 16), z1 = MIN(max[2], sz * 16 + 15);
+                int x0 = MAX(min[0], sx * 16), x1 = MIN(max[0], sx * 16 + 15);
+                for(int y = y0 ; y <= y1 ; y++)
+                    for(int z = z0 ; z <= z1 ; z++)
+                    {
+                        guint16* row = section->cells + (((y & 15) << 8) | ((z & 15) << 4));
+                        for(int x = x0 & 15 ; x <= (x1 & 15) ; x++)
+                        {
+                            if(row[x]) bounds_dirty = true;
+                            row[x] = 0;
+                        }
+                    }
+            }
+    for(auto it = block_entities.begin() ; it != block_entities.end() ; )
+    {
+        int pos[3];
+        unpack_pos(it->first, pos);
+        if(box_contains(box.min, box.max, pos)) it = block_entities.erase(it);
+        else ++it;
+    }
+}
+
+bool DhNbtBlockIndex::update_block(DhNbtInstance& block)
+{
+    if(!valid || litematic || !block.is_type(DH_TYPE_Compound)) return false;
+    block.thaw_all();
+    NBT* node = block.get_current_nbt();
+    int pos[3];
+    int local = -1;
+    if(!get_pos_list(find_child(node, "pos"), pos) || !pos_in_range(pos)
+       || !get_int(node, "state", local))
+        return false;
+    int state = structure_state(local);
+    if(state < 0) return false;
+    guint64 packed = pack_pos(pos[0], pos[1], pos[2]);
+
+    /* The entry moved, take it out of its old place */
+    auto old = entry_positions.find(node);
+    if(old != entry_positions.end() && old->second != packed)
+        clear_entry(node, old->second);
+    set_block(pos[0], pos[1], pos[2], state);
+    entry_positions[node] = packed;
+
+    NBT* entity = find_child(node, "nbt");
+    if(entity)
+    {
+        std::vector<NBT*> path = block.get_tree_struct();
+        path.push_back(node);
+        block_entities[packed] = { entity, path };
+    }
+    else block_entities.erase(packed);
+    return true;
+}
+
+void DhNbtBlockIndex::clear_entry(NBT* node, guint64 packed)
+{
+    int pos[3];
+    unpack_pos(packed, pos);
+    set_block(pos[0], pos[1], pos[2], -1);
+    auto entity = block_entities.find(packed);
+    if(entity != block_entities.end() && !entity->second.path.empty()
+       && entity->second.path.back() == node)
+        block_entities.erase(entity);
+}
+
+bool DhNbtBlockIndex::remove_block(DhNbtInstance& block)
+{
+    if(!valid || litematic) return false;
+    auto it = entry_positions.find(block.get_current_nbt());
+    if(it == entry_positions.end()) return false;
+    clear_entry(it->first, it->second);
+    entry_positions.erase(it);
+    return true;
+}
+
+static bool box_overlaps(const int a_min[3], const int a_max[3], const int b_min[3], const int b_max[3])
+{
+    for(int i = 0 ; i < 3 ; i++)
+        if(a_max[i] < b_min[i] || a_min[i] > b_max[i]) return false;
+    return true;
+}
+
+bool DhNbtBlockIndex::update_region(const char* name)
+{
+    if(!valid || !litematic || !name) return false;
+    root.thaw_all();
+    NBT* node = root.get_original_nbt();
+    NBT* list = find_child(node, "Regions");
+    NBT* region = find_child(list, name);
+    Decoded updated;
+    if(region)
+    {
+        updated.name = name;
+        updated.path = { node, list };
+        decode_region(region, updated);
+        if(!updated.ok) return false;
+    }
+
+    /* Where the region was and where it is now */
+    std::vector<Box> areas;
+    auto old = regions.find(name);
+    if(old != regions.end())
+    {
+        areas.push_back(old->second);
+        regions.erase(old);
+    }
+    if(region)
+    {
+        areas.push_back(updated.box);
+        regions[name] = updated.box;
+    }
+    for(auto& area : areas)
+        clear_box(area);
+
+    /* Write back every region there in list order, as later ones
+     * overwrite earlier ones in build() */
+    for(NBT* other = list ? list->child : nullptr ; other ; other = other->next)
+    {
+        if(!other->key) continue;
+        Decoded decoded;
+        Decoded* source = &updated;
+        if(other != region)
+        {
+            auto it = regions.find(other->key);
+            if(it == regions.end()) continue;
+            bool overlap = false;
+            for(auto& area : areas)
+                overlap = overlap || box_overlaps(it->second.min, it->second.max, area.min, area.max);
+            if(!overlap) continue;
+            decoded.name = other->key;
+            decoded.path = { node, list };
+            decode_region(other, decoded);
+            if(!decoded.ok) continue;
+            source = &decoded;
+        }
+        for(auto& area : areas)
+            merge(*source, &area);
+    }
+    bounds_dirty = true;
+    return true;
+}
@@ -0,0 +1,164 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_BLOCK_INDEX_HPP
+#define NBT_BLOCK_INDEX_HPP
+
+#include "nbt_interface.hpp"
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+typedef struct DhNbtBlockState
+{
+    std::string name;
+    /* Sorted "key=value,key=value", empty without properties */
+    std::string properties;
+} DhNbtBlockState;
+
+/* Point and box queries over the blocks of a structure (.nbt, with
+ * size/palette/blocks) or a litematic (Regions with BlockStatePalette
+ * and packed BlockStates). Blocks are kept as palette indices in 16^3
+ * sections, created only where something is, with one palette shared
+ * by all regions. Litematic coordinates are relative to the schematic
+ * origin, structure ones to the structure corner. Coordinates must be
+ * within [-2^20, 2^20), building fails on a block outside.
+ *
+ * The index refers to the block entity nodes of the tree, so after
+ * editing it, call the update functions for the edited part. Freezing
+ * or collecting subtrees of the tree frees those nodes: build the index
+ * again after them. Building and updating thaw the frozen subtrees they
+ * read. */
+class DhNbtBlockIndex
+{
+public:
+  DhNbtBlockIndex();
+
+  /* Regions (or parts of the block list) are decoded on `threads`
+   * threads, 0 for one per processor */
+  bool build(DhNbtInstance& root, int threads = 0);
+  bool is_valid() { return valid; }
+  bool is_litematic() { return litematic; }
+
+  /* Smallest box holding every block, false if empty */
+  bool get_bounds(int min[3], int max[3]);
+  /* Palette index, -1 for no block */
+  int get_state(int x, int y, int z);
+  const DhNbtBlockState* get_block(int x, int y, int z);
+  /* Block entity at the position, a cursor into the tree with its
+   * parents, so parent() leads back to the block or region */
+  bool get_block_entity(int x, int y, int z, DhNbtInstance& out);
+
+  int palette_size() { return palette.size(); }
+  const DhNbtBlockState& get_palette(int state) { return palette[state]; }
+  /* Index of the state, added to the palette if needed */
+  int add_state(const char* name, const char* properties);
+
+  /* `func(x, y, z, state)` for every block in the box, bounds included */
+  template<typename Func>
+  void for_each_in_box(const int min[3], const int max[3], Func func);
+
+  /* Incremental updates, only the index is changed. set_block() fails
+   * outside the coordinate range. */
+  bool set_block(int x, int y, int z, int state);
+  void set_block_entity(int x, int y, int z, DhNbtInstance& node);
+  void remove_block_entity(int x, int y, int z);
+  /* Re-read an edited or added entry of a structure `blocks` list, its
+   * previous position is cleared if it moved */
+  bool update_block(DhNbtInstance& block);
+  /* Forget an entry of a structure `blocks` list and clear its cell,
+   * to be called before it is removed from the tree */
+  bool remove_block(DhNbtInstance& block);
+  /* Re-read an edited, added or removed litematic region */
+  bool update_region(const char* name);
+
+private:
+  struct Section
+  {
+    /* State + 1, 0 for no block; index (y << 8) | (z << 4) | x */
+    guint16 cells[4096];
+  };
+  struct Box
+  {
+    int min[3];
+    int max[3];
+  };
+  struct Entity
+  {
+    NBT* node;
+    /* Parents of the node from the root */
+    std::vector<NBT*> path;
+  };
+  struct Decoded;
+
+  static guint64 pack_pos(int x, int y, int z);
+  static void unpack_pos(guint64 packed, int pos[3]);
+  static void decode_region(NBT* region, Decoded& out);
+  void decode_blocks(NBT** blocks, int n, Decoded& out);
+  Section* find_section(int x, int y, int z);
+  Section* get_section(int x, int y, int z);
+  void clear_box(const Box& box);
+  /* Clear the cell of a structure entry and its block entity */
+  void clear_entry(NBT* node, guint64 packed);
+  /* Regions are only written inside `area` if given */
+  void merge(Decoded& decoded, const Box* area = nullptr);
+  void update_bounds();
+  int intern(const std::string& name, const std::string& properties);
+  int structure_state(int local);
+
+  DhNbtInstance root;
+  std::unordered_map<guint64, std::unique_ptr<Section>> sections;
+  std::vector<DhNbtBlockState> palette;
+  std::unordered_map<std::string, int> palette_map;
+  std::unordered_map<guint64, Entity> block_entities;
+  /* Position of each structure entry, for update_block() */
+  std::unordered_map<NBT*, guint64> entry_positions;
+  /* Structure palette index to ours */
+  std::vector<int> structure_palette;
+  std::map<std::string, Box> regions;
+  Box bounds;
+  bool has_bounds;
+  /* A block was removed, bounds may be too large */
+  bool bounds_dirty;
+  bool litematic;
+  bool valid;
+};
+
+template<typename Func>
+void DhNbtBlockIndex::for_each_in_box(const int min[3], const int max[3], Func func)
+{
+    for(int sy = min[1] >> 4 ; sy <= max[1] >> 4 ; sy++)
+        for(int sz = min[2] >> 4 ; sz <= max[2] >> 4 ; sz++)
+            for(int sx = min[0] >> 4 ; sx <= max[0] >> 4 ; sx++)
+            {
+                Section* section = find_section(sx * 16, sy * 16, sz * 16);
+                if(!section) continue;
+                int y0 = MAX(min[1], sy * 16), y1 = MIN(max[1], sy * 16 + 15);
+                int z0 = MAX(min[2], sz * 16), z1 = MIN(max[2], sz * 16 + 15);
+                int x0 = MAX(min[0], sx * 16), x1 = MIN(max[0], sx * 16 + 15);
+                for(int y = y0 ; y <= y1 ; y++)
+                    for(int z = z0 ; z <= z1 ; z++)
+                    {
+                        const guint16* row = section->cells + (((y & 15) << 8) | ((z & 15) << 4));
+                        for(int x = x0 ; x <= x1 ; x++)
+                            if(row[x & 15]) func(x, y, z, row[x & 15] - 1);
+                    }
+            }
+}
+
+#endif /* NBT_BLOCK_INDEX_HPP */
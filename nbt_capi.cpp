@@ -0,0 +1,614 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_interface.hpp"
+#include "nbt_codec.hpp"
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+static DhNbtInstance* get_instance(void* instance)
+{
+    return static_cast<DhNbtInstance*>(instance);
+}
+
+/* No exception may cross the C ABI: the body of every entry point
+ * runs in here, and returns `fail` on one */
+template<typename Ret, typename Func>
+static Ret c_call(Ret fail, Func func)
+{
+    try
+    {
+        return func();
+    }
+    catch(...)
+    {
+        return fail;
+    }
+}
+
+template<typename Func>
+static void c_call(Func func)
+{
+    try
+    {
+        func();
+    }
+    catch(...)
+    {
+    }
+}
+
+/* Run `func` on the instance, FALSE on an exception */
+template<typename Func>
+static gboolean guard(void* instance, Func func)
+{
+    if(!instance) return FALSE;
+    return c_call<gboolean>(FALSE, [&]() {
+        func(*get_instance(instance));
+        return TRUE;
+    });
+}
+
+static guint8* copy_buffer(const std::vector<guint8>& data, gsize* len)
+{
+    guint8* ret = (guint8*)g_malloc(data.size() ? data.size() : 1);
+    memcpy(ret, data.data(), data.size());
+    if(len) *len = data.size();
+    return ret;
+}
+
+/* First child of `node`, thawing it if frozen, as child() does */
+static NBT* first_child(DhNbtInstance* instance, NBT* node)
+{
+    NBT* child = nullptr;
+    if(!dh_nbt_freeze_enter(instance->get_freeze_root(), node, child))
+        throw std::runtime_error("frozen subtree can not be decoded");
+    return child;
+}
+
+/* Batch arguments: NULL arrays and NULL keys are rejected */
+static bool valid_keys(const char* const* keys, int n)
+{
+    if(n < 0 || (n > 0 && !keys)) return false;
+    for(int i = 0 ; i < n ; i++)
+        if(!keys[i]) return false;
+    return true;
+}
+
+/* Children of the current compound matched against `keys` in one pass,
+ * `func(index, node)` is called for the first child of each key */
+template<typename Func>
+static int match_children(DhNbtInstance* instance, const char* const* keys, int n, Func func)
+{
+    if(!instance || !instance->is_type(DH_TYPE_Compound)) return 0;
+    std::unordered_map<std::string_view, std::vector<int>> wanted;
+    for(int i = 0 ; i < n ; i++)
+        wanted[keys[i]].push_back(i);
+
+    int found = 0;
+    NBT* first = first_child(instance, instance->get_current_nbt());
+    for(NBT* child = first ; child && !wanted.empty() ; child = child->next)
+    {
+        if(!child->key) continue;
+        auto it = wanted.find(child->key);
+        if(it == wanted.end()) continue;
+        for(int index : it->second)
+        {
+            if(func(index, child)) found++;
+        }
+        wanted.erase(it);
+    }
+    return found;
+}
+
+static void flatten_node(DhNbtInstance* instance, NBT* node, gint32 parent,
+                         std::vector<DhNbtFlatNode>& nodes, std::vector<guint8>& pool)
+{
+    DhNbtFlatNode flat;
+    memset(&flat, 0, sizeof(flat));
+    flat.type = node->type + 1;
+    flat.parent = parent;
+    flat.key = -1;
+    if(node->key)
+    {
+        flat.key = pool.size();
+        pool.insert(pool.end(), node->key, node->key + strlen(node->key) + 1);
+    }
+
+    switch(node->type)
+    {
+        case TAG_Byte:
+        case TAG_Short:
+        case TAG_Int:
+        case TAG_Long:
+            flat.value.i = node->value_i;
+            break;
+        case TAG_Float:
+        case TAG_Double:
+            flat.value.d = node->value_d;
+            break;
+        case TAG_String:
+        {
+            const char* str = (const char*)node->value_a.value;
+            flat.len = strlen(str);
+            flat.value.offset = pool.size();
+            pool.insert(pool.end(), str, str + flat.len + 1);
+            break;
+        }
+        case TAG_Byte_Array:
+        case TAG_Int_Array:
+        case TAG_Long_Array:
+        {
+            int width = node->type == TAG_Byte_Array ? 1 : (node->type == TAG_Int_Array ? 4 : 8);
+            /* Keep the elements aligned for the reader */
+            pool.resize((pool.size() + 7) & ~(gsize)7);
+            flat.len = node->value_a.len;
+            flat.value.offset = pool.size();
+            const guint8* data = (const guint8*)node->value_a.value;
+            pool.insert(pool.end(), data, data + (gsize)flat.len * width);
+            break;
+        }
+        default:
+            break;
+    }
+
+    gint32 self = nodes.size();
+    nodes.push_back(flat);
+    if(node->type == TAG_List || node->type == TAG_Compound)
+    {
+        int len = 0;
+        for(NBT* child = first_child(instance, node) ; child ; child = child->next, len++)
+            flatten_node(instance, child, self, nodes, pool);
+        nodes[self].len = len;
+    }
+}
+
+extern "C"
+{
+    void* dh_nbt_instance_cpp_new()
+    {
+        return c_call<void*>(nullptr, []() { return new DhNbtInstance(); });
+    }
+
+    void* dh_nbt_instance_cpp_new_from_file(const char* filename)
+    {
+        return c_call<void*>(nullptr, [&]() -> void* {
+            DhNbtInstance* instance = new DhNbtInstance(filename);
+            if(instance->is_non_null()) return instance;
+            delete instance;
+            return nullptr;
+        });
+    }
+
+    void* dh_nbt_instance_cpp_new_type(DhNbtType type, const char* key, gboolean temporary_root)
+    {
+        if(type <= DH_TYPE_End || type > DH_TYPE_Long_Array) return nullptr;
+        return c_call<void*>(nullptr, [&]() { return new DhNbtInstance(type, key, temporary_root); });
+    }
+
+    void* dh_nbt_instance_cpp_dup(void* instance)
+    {
+        if(!instance) return nullptr;
+        return c_call<void*>(nullptr, [&]() { return new DhNbtInstance(*get_instance(instance)); });
+    }
+
+    void* dh_nbt_instance_cpp_dup_current(void* instance)
+    {
+        return c_call<void*>(nullptr, [&]() -> void* {
+            if(!instance || !get_instance(instance)->is_non_null()) return nullptr;
+            return new DhNbtInstance(get_instance(instance)->dup_current_as_original(false));
+        });
+    }
+
+    void  dh_nbt_instance_cpp_free(void* mem)
+    {
+        c_call([&]() { delete get_instance(mem); });
+    }
+
+    gboolean dh_nbt_instance_cpp_child(void* instance)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && get_instance(instance)->child(); });
+    }
+
+    gboolean dh_nbt_instance_cpp_child_key(void* instance, const char* key)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && key && get_instance(instance)->child(key); });
+    }
+
+    gboolean dh_nbt_instance_cpp_child_index(void* instance, int index)
+    {
+        return c_call<gboolean>(FALSE, [&]() {
+            if(!instance || index < 0 || index >= get_instance(instance)->child_value())
+                return false;
+            return get_instance(instance)->child(index);
+        });
+    }
+
+    gboolean dh_nbt_instance_cpp_next(void* instance)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && get_instance(instance)->next(); });
+    }
+
+    gboolean dh_nbt_instance_cpp_prev(void* instance)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && get_instance(instance)->prev(); });
+    }
+
+    gboolean dh_nbt_instance_cpp_parent(void* instance)
+    {
+        return c_call<gboolean>(FALSE, [&]() {
+            if(!instance || get_instance(instance)->get_tree_struct().empty())
+                return false;
+            return get_instance(instance)->parent();
+        });
+    }
+
+    void dh_nbt_instance_cpp_goto_root(void* instance)
+    {
+        c_call([&]() { if(instance) get_instance(instance)->goto_root(); });
+    }
+
+    gboolean dh_nbt_instance_cpp_is_non_null(void* instance)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && get_instance(instance)->is_non_null(); });
+    }
+
+    DhNbtType dh_nbt_instance_cpp_get_type(void* instance)
+    {
+        return c_call(DH_TYPE_INVALID, [&]() {
+            return instance ? get_instance(instance)->get_type() : DH_TYPE_INVALID;
+        });
+    }
+
+    int dh_nbt_instance_cpp_child_value(void* instance)
+    {
+        return c_call(0, [&]() { return instance ? get_instance(instance)->child_value() : 0; });
+    }
+
+    const char* dh_nbt_instance_cpp_get_key(void* instance)
+    {
+        return c_call<const char*>(nullptr, [&]() {
+            return instance ? get_instance(instance)->get_key() : nullptr;
+        });
+    }
+
+    void dh_nbt_instance_cpp_set_key(void* instance, const char* key)
+    {
+        c_call([&]() { if(instance) get_instance(instance)->set_key(key); });
+    }
+
+    gboolean dh_nbt_instance_cpp_get_integer(void* instance, gint64* val)
+    {
+        return val && guard(instance, [&](DhNbtInstance& self) { *val = self.get_integer(); });
+    }
+
+    gboolean dh_nbt_instance_cpp_get_double(void* instance, double* val)
+    {
+        return val && guard(instance, [&](DhNbtInstance& self) {
+            *val = self.is_type(DH_TYPE_Float) ? self.get_float() : self.get_double();
+        });
+    }
+
+    const char* dh_nbt_instance_cpp_get_string(void* instance)
+    {
+        const char* ret = nullptr;
+        guard(instance, [&](DhNbtInstance& self) { ret = self.get_string(); });
+        return ret;
+    }
+
+    const gint8* dh_nbt_instance_cpp_get_byte_array(void* instance, int* len)
+    {
+        const gint8* ret = nullptr;
+        if(len) guard(instance, [&](DhNbtInstance& self) { ret = self.get_byte_array(*len); });
+        return ret;
+    }
+
+    const gint32* dh_nbt_instance_cpp_get_int_array(void* instance, int* len)
+    {
+        const gint32* ret = nullptr;
+        if(len) guard(instance, [&](DhNbtInstance& self) { ret = self.get_int_array(*len); });
+        return ret;
+    }
+
+    const gint64* dh_nbt_instance_cpp_get_long_array(void* instance, int* len)
+    {
+        const gint64* ret = nullptr;
+        if(len) guard(instance, [&](DhNbtInstance& self) { ret = self.get_long_array(*len); });
+        return ret;
+    }
+
+    gboolean dh_nbt_instance_cpp_set_integer(void* instance, gint64 val)
+    {
+        return guard(instance, [&](DhNbtInstance& self) { self.set_integer(val); });
+    }
+
+    gboolean dh_nbt_instance_cpp_set_double(void* instance, double val)
+    {
+        return guard(instance, [&](DhNbtInstance& self) {
+            if(self.is_type(DH_TYPE_Float)) self.set_float(val);
+            else self.set_double(val);
+        });
+    }
+
+    gboolean dh_nbt_instance_cpp_set_string(void* instance, const char* val)
+    {
+        return val && guard(instance, [&](DhNbtInstance& self) { self.set_string(val); });
+    }
+
+    gboolean dh_nbt_instance_cpp_set_byte_array(void* instance, const gint8* val, int len)
+    {
+        return len >= 0 && guard(instance, [&](DhNbtInstance& self) { self.set_byte_array(val, len); });
+    }
+
+    gboolean dh_nbt_instance_cpp_set_int_array(void* instance, const gint32* val, int len)
+    {
+        return len >= 0 && guard(instance, [&](DhNbtInstance& self) { self.set_int_array(val, len); });
+    }
+
+    gboolean dh_nbt_instance_cpp_set_long_array(void* instance, const gint64* val, int len)
+    {
+        return len >= 0 && guard(instance, [&](DhNbtInstance& self) { self.set_long_array(val, len); });
+    }
+
+    gboolean dh_nbt_instance_cpp_insert_before(void* instance, void* sibling, void* node)
+    {
+        if(!instance || !node) return FALSE;
+        return c_call<gboolean>(FALSE, [&]() {
+            DhNbtInstance* self = get_instance(instance);
+            if(!self->is_type(DH_TYPE_Compound) && !self->is_type(DH_TYPE_List)) return false;
+            return self->insert_before(sibling ? *get_instance(sibling) : DhNbtInstance(), *get_instance(node));
+        });
+    }
+
+    gboolean dh_nbt_instance_cpp_insert_after(void* instance, void* sibling, void* node)
+    {
+        if(!instance || !node) return FALSE;
+        return c_call<gboolean>(FALSE, [&]() {
+            DhNbtInstance* self = get_instance(instance);
+            if(!self->is_type(DH_TYPE_Compound) && !self->is_type(DH_TYPE_List)) return false;
+            return self->insert_after(sibling ? *get_instance(sibling) : DhNbtInstance(), *get_instance(node));
+        });
+    }
+
+    gboolean dh_nbt_instance_cpp_rm_node_key(void* instance, const char* key)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && key && get_instance(instance)->rm_node(key); });
+    }
+
+    gboolean dh_nbt_instance_cpp_rm_node_index(void* instance, int index)
+    {
+        return c_call<gboolean>(FALSE, [&]() {
+            if(!instance || index < 0 || index >= get_instance(instance)->child_value())
+                return false;
+            return get_instance(instance)->rm_node(index);
+        });
+    }
+
+    int dh_nbt_instance_cpp_get_children(void* instance, const char* const* keys, int n, void** out)
+    {
+        if(!valid_keys(keys, n) || (n > 0 && !out)) return -1;
+        for(int i = 0 ; i < n ; i++)
+            out[i] = nullptr;
+        int ret = c_call(-1, [&]() {
+            DhNbtInstance base;
+            if(instance)
+            {
+                base = *get_instance(instance);
+                if(!base.is_type(DH_TYPE_Compound)) return 0;
+            }
+            return match_children(get_instance(instance), keys, n, [&](int index, NBT* node) {
+                DhNbtInstance* child = new DhNbtInstance(base);
+                child->child();
+                child->set_current_nbt(node);
+                out[index] = child;
+                return true;
+            });
+        });
+        if(ret >= 0) return ret;
+        /* Nothing half done is handed out */
+        for(int i = 0 ; i < n ; i++)
+        {
+            delete get_instance(out[i]);
+            out[i] = nullptr;
+        }
+        return -1;
+    }
+
+    int dh_nbt_instance_cpp_get_integers(void* instance, const char* const* keys, int n,
+                                         gint64* out, gboolean* found)
+    {
+        if(!valid_keys(keys, n) || (n > 0 && (!out || !found))) return -1;
+        for(int i = 0 ; i < n ; i++)
+            found[i] = FALSE;
+        return c_call(-1, [&]() {
+            return match_children(get_instance(instance), keys, n, [&](int index, NBT* node) {
+                if(node->type < TAG_Byte || node->type > TAG_Long) return false;
+                out[index] = node->value_i;
+                found[index] = TRUE;
+                return true;
+            });
+        });
+    }
+
+    int dh_nbt_instance_cpp_get_doubles(void* instance, const char* const* keys, int n,
+                                        double* out, gboolean* found)
+    {
+        if(!valid_keys(keys, n) || (n > 0 && (!out || !found))) return -1;
+        for(int i = 0 ; i < n ; i++)
+            found[i] = FALSE;
+        return c_call(-1, [&]() {
+            return match_children(get_instance(instance), keys, n, [&](int index, NBT* node) {
+                if(node->type == TAG_Float || node->type == TAG_Double)
+                    out[index] = node->value_d;
+                else if(node->type >= TAG_Byte && node->type <= TAG_Long)
+                    out[index] = node->value_i;
+                else return false;
+                found[index] = TRUE;
+                return true;
+            });
+        });
+    }
+
+    int dh_nbt_instance_cpp_list_get_integers(void* instance, gint64* out, int capacity)
+    {
+        if(capacity < 0 || (!out && capacity > 0)) return -1;
+        if(!instance || !get_instance(instance)->is_non_null()) return -1;
+        NBT* node = get_instance(instance)->get_current_nbt();
+        int len = node->value_a.len;
+        switch(node->type)
+        {
+            case TAG_Byte_Array:
+                for(int i = 0 ; i < len && i < capacity ; i++)
+                    out[i] = ((gint8*)node->value_a.value)[i];
+                return len;
+            case TAG_Int_Array:
+                for(int i = 0 ; i < len && i < capacity ; i++)
+                    out[i] = ((gint32*)node->value_a.value)[i];
+                return len;
+            case TAG_Long_Array:
+                if(capacity) memcpy(out, node->value_a.value, sizeof(gint64) * MIN(len, capacity));
+                return len;
+            case TAG_List:
+            {
+                NBT* first = nullptr;
+                if(!c_call<bool>(false, [&]() { first = first_child(get_instance(instance), node); return true; }))
+                    return -1;
+                int ret = 0;
+                for(NBT* child = first ; child ; child = child->next, ret++)
+                {
+                    if(child->type < TAG_Byte || child->type > TAG_Long) return -1;
+                    if(ret < capacity) out[ret] = child->value_i;
+                }
+                return ret;
+            }
+            default:
+                return -1;
+        }
+    }
+
+    int dh_nbt_instance_cpp_list_get_doubles(void* instance, double* out, int capacity)
+    {
+        if(capacity < 0 || (!out && capacity > 0)) return -1;
+        if(!instance || !get_instance(instance)->is_type(DH_TYPE_List)) return -1;
+        NBT* node = get_instance(instance)->get_current_nbt();
+        NBT* first = nullptr;
+        if(!c_call<bool>(false, [&]() { first = first_child(get_instance(instance), node); return true; }))
+            return -1;
+        int ret = 0;
+        for(NBT* child = first ; child ; child = child->next, ret++)
+        {
+            if(child->type != TAG_Float && child->type != TAG_Double) return -1;
+            if(ret < capacity) out[ret] = child->value_d;
+        }
+        return ret;
+    }
+
+    gboolean dh_nbt_instance_cpp_flatten(void* instance, DhNbtFlatNode** nodes, gsize* n_nodes,
+                                         guint8** pool, gsize* pool_len)
+    {
+        if(!instance || !nodes || !n_nodes || !pool || !pool_len) return FALSE;
+        return c_call<gboolean>(FALSE, [&]() {
+            if(!get_instance(instance)->is_non_null()) return false;
+            std::vector<DhNbtFlatNode> flat_nodes;
+            std::vector<guint8> flat_pool;
+            flatten_node(get_instance(instance), get_instance(instance)->get_current_nbt(), -1,
+                         flat_nodes, flat_pool);
+            *nodes = (DhNbtFlatNode*)g_malloc(sizeof(DhNbtFlatNode) * flat_nodes.size());
+            memcpy(*nodes, flat_nodes.data(), sizeof(DhNbtFlatNode) * flat_nodes.size());
+            *n_nodes = flat_nodes.size();
+            *pool = copy_buffer(flat_pool, pool_len);
+            return true;
+        });
+    }
+
+    guint8* dh_nbt_instance_cpp_dump(void* instance, gsize* len)
+    {
+        return c_call<guint8*>(nullptr, [&]() -> guint8* {
+            if(!instance || !get_instance(instance)->is_non_null()) return nullptr;
+            std::vector<guint8> data;
+            DhNbtInstance* cursor = get_instance(instance);
+            dh_nbt_write_node(cursor->get_current_nbt(), true, data, cursor->get_freeze_root());
+            return copy_buffer(data, len);
+        });
+    }
+
+    guint8* dh_nbt_instance_cpp_pack(void* instance, DhNbtCompression compression, gsize* len)
+    {
+        return c_call<guint8*>(nullptr, [&]() -> guint8* {
+            std::vector<guint8> data;
+            if(!instance || !get_instance(instance)->pack(data, compression)) return nullptr;
+            return copy_buffer(data, len);
+        });
+    }
+
+    gboolean dh_nbt_instance_cpp_save_to_file(void* instance, const char* pos, DhNbtCompression compression)
+    {
+        return c_call<gboolean>(FALSE, [&]() {
+            return instance && get_instance(instance)->save_to_file(pos, compression);
+        });
+    }
+
+    gboolean dh_nbt_instance_cpp_save_to_file_atomic(void* instance, const char* pos,
+                                                     DhNbtCompression compression, DhNbtFsyncPolicy policy)
+    {
+        return c_call<gboolean>(FALSE, [&]() {
+            return instance && get_instance(instance)->save_to_file_atomic(pos, compression, policy);
+        });
+    }
+
+    gboolean dh_nbt_instance_cpp_freeze(void* instance, DhNbtCompression compression)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && get_instance(instance)->freeze(compression); });
+    }
+
+    gboolean dh_nbt_instance_cpp_thaw(void* instance)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && get_instance(instance)->thaw(); });
+    }
+
+    gsize dh_nbt_instance_cpp_thaw_all(void* instance)
+    {
+        return c_call<gsize>(0, [&]() { return instance ? get_instance(instance)->thaw_all() : 0; });
+    }
+
+    gboolean dh_nbt_instance_cpp_is_frozen(void* instance)
+    {
+        return c_call<gboolean>(FALSE, [&]() { return instance && get_instance(instance)->is_frozen(); });
+    }
+
+    void dh_nbt_instance_cpp_set_freeze_budget(void* instance, gsize budget)
+    {
+        c_call([&]() { if(instance) get_instance(instance)->set_freeze_budget(budget); });
+    }
+
+    gsize dh_nbt_instance_cpp_collect_frozen(void* instance)
+    {
+        return c_call<gsize>(0, [&]() { return instance ? get_instance(instance)->collect_frozen() : 0; });
+    }
+
+    gboolean dh_nbt_instance_cpp_get_freeze_stats(void* instance, DhNbtFreezeStats* stats)
+    {
+        if(!instance || !stats) return FALSE;
+        return c_call<gboolean>(FALSE, [&]() {
+            *stats = get_instance(instance)->get_freeze_stats();
+            return true;
+        });
+    }
+}
@@ -0,0 +1,394 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_codec.hpp"
+#include "nbt_stats.hpp"
+#include <cstring>
+
+static int array_width(NBT_Tags type)
+{
+    switch(type)
+    {
+        case TAG_Byte_Array: return 1;
+        case TAG_Int_Array:  return 4;
+        case TAG_Long_Array: return 8;
+        default: return 0;
+    }
+}
+
+/* Smallest encoded payload of `type`, 0 for TAG_End */
+static int min_payload(NBT_Tags type)
+{
+    switch(type)
+    {
+        case TAG_Byte:
+        case TAG_Compound:   return 1;
+        case TAG_Short:
+        case TAG_String:     return 2;
+        case TAG_Int:
+        case TAG_Float:
+        case TAG_Byte_Array:
+        case TAG_Int_Array:
+        case TAG_Long_Array: return 4;
+        case TAG_Long:
+        case TAG_Double:     return 8;
+        case TAG_List:       return 5;
+        default: return 0;
+    }
+}
+
+/* A list header that the remaining input can hold */
+static bool valid_list(guint64 elem_type, gint32 len, const guint8* pos, const guint8* end)
+{
+    if(elem_type > TAG_Long_Array || len < 0) return false;
+    if(len == 0) return true;
+    int size = min_payload((NBT_Tags)elem_type);
+    return size && (guint64)len * size <= (guint64)(end - pos);
+}
+
+void dh_nbt_put_be(std::vector<guint8>& out, guint64 val, int bytes)
+{
+    for(int i = bytes - 1 ; i >= 0 ; i--)
+        out.push_back((guint8)(val >> (8 * i)));
+}
+
+bool dh_nbt_get_be(const guint8*& pos, const guint8* end, int bytes, guint64& val)
+{
+    if(end - pos < bytes) return false;
+    val = 0;
+    for(int i = 0 ; i < bytes ; i++)
+        val = (val << 8) | *pos++;
+    return true;
+}
+
+bool dh_nbt_put_string(std::vector<guint8>& out, const char* str)
+{
+    size_t len = str ? strlen(str) : 0;
+    if(len > 0xffff)
+    {
+        /* Cutting it would split a character, keep the output readable */
+        dh_nbt_put_be(out, 0, 2);
+        return false;
+    }
+    dh_nbt_put_be(out, len, 2);
+    out.insert(out.end(), (const guint8*)str, (const guint8*)str + len);
+    return true;
+}
+
+static char* get_string(const guint8*& pos, const guint8* end)
+{
+    guint64 len = 0;
+    if(!dh_nbt_get_be(pos, end, 2, len) || (guint64)(end - pos) < len)
+        return nullptr;
+    char* str = (char*)malloc(len + 1);
+    DH_NBT_STAT_ADD(DH_STAT_STRDUP_BYTES, len + 1);
+    memcpy(str, pos, len);
+    str[len] = 0;
+    pos += len;
+    return str;
+}
+
+void dh_nbt_write_payload(NBT* node, std::vector<guint8>& out, DhNbtFreezeRoot* frozen)
+{
+    switch(node->type)
+    {
+        case TAG_Byte:  dh_nbt_put_be(out, node->value_i, 1); break;
+        case TAG_Short: dh_nbt_put_be(out, node->value_i, 2); break;
+        case TAG_Int:   dh_nbt_put_be(out, node->value_i, 4); break;
+        case TAG_Long:  dh_nbt_put_be(out, node->value_i, 8); break;
+        case TAG_Float:
+        {
+            float f = node->value_d;
+            guint32 bits;
+            memcpy(&bits, &f, 4);
+            dh_nbt_put_be(out, bits, 4);
+            break;
+        }
+        case TAG_Double:
+        {
+            guint64 bits;
+            memcpy(&bits, &node->value_d, 8);
+            dh_nbt_put_be(out, bits, 8);
+            break;
+        }
+        case TAG_String:
+            dh_nbt_put_string(out, (const char*)node->value_a.value);
+            break;
+        case TAG_Byte_Array:
+        case TAG_Int_Array:
+        case TAG_Long_Array:
+        {
+            int width = array_width(node->type);
+            int len = node->value_a.len;
+            dh_nbt_put_be(out, len, 4);
+            for(int i = 0 ; i < len ; i++)
+            {
+                guint64 val;
+                if(width == 1)      val = ((gint8*)node->value_a.value)[i];
+                else if(width == 4) val = ((gint32*)node->value_a.value)[i];
+                else                val = ((gint64*)node->value_a.value)[i];
+                dh_nbt_put_be(out, val, width);
+            }
+            break;
+        }
+        case TAG_List:
+        {
+            if(frozen && dh_nbt_frozen_payload(frozen, node, out)) break;
+            NBT* first = dh_nbt_child(node);
+            int len = 0;
+            for(NBT* child = first ; child ; child = child->next)
+                len++;
+            dh_nbt_put_be(out, first ? first->type : TAG_End, 1);
+            dh_nbt_put_be(out, len, 4);
+            for(NBT* child = first ; child ; child = child->next)
+                dh_nbt_write_payload(child, out, frozen);
+            break;
+        }
+        case TAG_Compound:
+            if(frozen && dh_nbt_frozen_payload(frozen, node, out)) break;
+            for(NBT* child = dh_nbt_child(node) ; child ; child = child->next)
+                dh_nbt_write_node(child, true, out, frozen);
+            dh_nbt_put_be(out, TAG_End, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+void dh_nbt_write_node(NBT* node, bool named, std::vector<guint8>& out, DhNbtFreezeRoot* frozen)
+{
+    dh_nbt_put_be(out, node->type, 1);
+    if(named) dh_nbt_put_string(out, node->key);
+    dh_nbt_write_payload(node, out, frozen);
+}
+
+static void append_child(NBT* parent, NBT*& last, NBT* child)
+{
+    child->prev = last;
+    if(last) last->next = child;
+    else parent->child = child;
+    last = child;
+}
+
+static NBT* read_node(bool named, const guint8*& pos, const guint8* end, int depth);
+
+static NBT* read_payload(NBT_Tags type, const guint8*& pos, const guint8* end, int depth)
+{
+    if((type == TAG_List || type == TAG_Compound) && depth >= DH_NBT_MAX_DEPTH)
+        return nullptr;
+    NBT* node = (NBT*)calloc(1, sizeof(NBT));
+    node->type = type;
+    DH_NBT_STAT_ADD(DH_STAT_NODES_ALLOCATED, 1);
+    guint64 val = 0;
+    bool ok = true;
+    switch(type)
+    {
+        case TAG_Byte:
+            ok = dh_nbt_get_be(pos, end, 1, val);
+            node->value_i = (gint8)val;
+            break;
+        case TAG_Short:
+            ok = dh_nbt_get_be(pos, end, 2, val);
+            node->value_i = (gint16)val;
+            break;
+        case TAG_Int:
+            ok = dh_nbt_get_be(pos, end, 4, val);
+            node->value_i = (gint32)val;
+            break;
+        case TAG_Long:
+            ok = dh_nbt_get_be(pos, end, 8, val);
+            node->value_i = (gint64)val;
+            break;
+        case TAG_Float:
+        {
+            ok = dh_nbt_get_be(pos, end, 4, val);
+            guint32 bits = val;
+            float f;
+            memcpy(&f, &bits, 4);
+            node->value_d = f;
+            break;
+        }
+        case TAG_Double:
+            ok = dh_nbt_get_be(pos, end, 8, val);
+            memcpy(&node->value_d, &val, 8);
+            break;
+        case TAG_String:
+        {
+            char* str = get_string(pos, end);
+            ok = str != nullptr;
+            if(ok)
+            {
+                node->value_a.value = str;
+                node->value_a.len = strlen(str) + 1;
+            }
+            break;
+        }
+        case TAG_Byte_Array:
+        case TAG_Int_Array:
+        case TAG_Long_Array:
+        {
+            int width = array_width(type);
+            ok = dh_nbt_get_be(pos, end, 4, val);
+            gint32 len = (gint32)val;
+            /* Up to 2^31 elements of 8 bytes, the size does not fit an int */
+            gsize bytes = ok && len >= 0 ? (gsize)len * width : 0;
+            void* arr = nullptr;
+            if(!ok || len < 0 || (guint64)(end - pos) < bytes
+               || !(arr = malloc(bytes + 1)))
+            {
+                ok = false;
+                break;
+            }
+            for(int i = 0 ; i < len ; i++)
+            {
+                dh_nbt_get_be(pos, end, width, val);
+                if(width == 1)      ((gint8*)arr)[i] = val;
+                else if(width == 4) ((gint32*)arr)[i] = val;
+                else                ((gint64*)arr)[i] = val;
+            }
+            node->value_a.value = arr;
+            node->value_a.len = len;
+            break;
+        }
+        case TAG_List:
+        {
+            guint64 elem_type = 0;
+            ok = dh_nbt_get_be(pos, end, 1, elem_type) && dh_nbt_get_be(pos, end, 4, val);
+            gint32 len = (gint32)val;
+            if(!ok || !valid_list(elem_type, len, pos, end))
+            {
+                ok = false;
+                break;
+            }
+            NBT* last = nullptr;
+            for(int i = 0 ; i < len && ok ; i++)
+            {
+                NBT* child = read_payload((NBT_Tags)elem_type, pos, end, depth + 1);
+                if(child) append_child(node, last, child);
+                else ok = false;
+            }
+            break;
+        }
+        case TAG_Compound:
+        {
+            NBT* last = nullptr;
+            while(ok)
+            {
+                if(pos < end && *pos == TAG_End)
+                {
+                    pos++;
+                    break;
+                }
+                NBT* child = read_node(true, pos, end, depth + 1);
+                if(child) append_child(node, last, child);
+                else ok = false;
+            }
+            break;
+        }
+        default:
+            ok = (type == TAG_End);
+            break;
+    }
+    if(ok) return node;
+    dh_nbt_free(node);
+    return nullptr;
+}
+
+static NBT* read_node(bool named, const guint8*& pos, const guint8* end, int depth)
+{
+    guint64 type = 0;
+    if(!dh_nbt_get_be(pos, end, 1, type) || type == TAG_End || type > TAG_Long_Array)
+        return nullptr;
+    char* key = nullptr;
+    if(named && !(key = get_string(pos, end)))
+        return nullptr;
+    NBT* node = read_payload((NBT_Tags)type, pos, end, depth);
+    if(node) node->key = key;
+    else free(key);
+    return node;
+}
+
+NBT* dh_nbt_read_payload(NBT_Tags type, const guint8*& pos, const guint8* end)
+{
+    return read_payload(type, pos, end, 0);
+}
+
+NBT* dh_nbt_read_node(bool named, const guint8*& pos, const guint8* end)
+{
+    return read_node(named, pos, end, 0);
+}
+
+static bool skip_payload(NBT_Tags type, const guint8*& pos, const guint8* end, int depth)
+{
+    guint64 val = 0;
+    if((type == TAG_List || type == TAG_Compound) && depth >= DH_NBT_MAX_DEPTH)
+        return false;
+    switch(type)
+    {
+        case TAG_Byte:   return dh_nbt_get_be(pos, end, 1, val);
+        case TAG_Short:  return dh_nbt_get_be(pos, end, 2, val);
+        case TAG_Int:
+        case TAG_Float:  return dh_nbt_get_be(pos, end, 4, val);
+        case TAG_Long:
+        case TAG_Double: return dh_nbt_get_be(pos, end, 8, val);
+        case TAG_String:
+            if(!dh_nbt_get_be(pos, end, 2, val) || (guint64)(end - pos) < val)
+                return false;
+            pos += val;
+            return true;
+        case TAG_Byte_Array:
+        case TAG_Int_Array:
+        case TAG_Long_Array:
+        {
+            if(!dh_nbt_get_be(pos, end, 4, val) || (gint32)val < 0)
+                return false;
+            guint64 bytes = val * array_width(type);
+            if((guint64)(end - pos) < bytes) return false;
+            pos += bytes;
+            return true;
+        }
+        case TAG_List:
+        {
+            guint64 elem_type = 0;
+            if(!dh_nbt_get_be(pos, end, 1, elem_type) || !dh_nbt_get_be(pos, end, 4, val)
+               || !valid_list(elem_type, (gint32)val, pos, end))
+                return false;
+            for(guint64 i = 0 ; i < val ; i++)
+                if(!skip_payload((NBT_Tags)elem_type, pos, end, depth + 1)) return false;
+            return true;
+        }
+        case TAG_Compound:
+            while(true)
+            {
+                guint64 child_type = 0;
+                if(!dh_nbt_get_be(pos, end, 1, child_type) || child_type > TAG_Long_Array)
+                    return false;
+                if(child_type == TAG_End) return true;
+                if(!dh_nbt_get_be(pos, end, 2, val) || (guint64)(end - pos) < val)
+                    return false;
+                pos += val;
+                if(!skip_payload((NBT_Tags)child_type, pos, end, depth + 1)) return false;
+            }
+        default:
+            return type == TAG_End;
+    }
+}
+
+bool dh_nbt_skip_payload(NBT_Tags type, const guint8*& pos, const guint8* end)
+{
+    return skip_payload(type, pos, end, 0);
+}
@@ -0,0 +1,52 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_CODEC_HPP
+#define NBT_CODEC_HPP
+
+#include "nbt_interface.hpp"
+
+/* Raw (uncompressed, big-endian) NBT encoding of a single node.
+ * Unlike NBT_Pack, these work on any node of a tree and never
+ * follow the `next` link of the node they are given. */
+
+/* Append the payload of `node` (no type byte, no key). Frozen subtrees
+ * are written from the blobs of `frozen`, the table of the root; without
+ * it they are written empty, as they read. */
+void dh_nbt_write_payload(NBT* node, std::vector<guint8>& out, DhNbtFreezeRoot* frozen = nullptr);
+/* Append type byte, key (if `named`) and payload */
+void dh_nbt_write_node(NBT* node, bool named, std::vector<guint8>& out, DhNbtFreezeRoot* frozen = nullptr);
+
+/* Nesting of lists and compounds accepted by the readers, as in Minecraft */
+#define DH_NBT_MAX_DEPTH 512
+
+/* Read a payload of `type`, advancing `pos`; nullptr if malformed
+ * or nested deeper than DH_NBT_MAX_DEPTH */
+NBT* dh_nbt_read_payload(NBT_Tags type, const guint8*& pos, const guint8* end);
+/* Read type byte, key (if `named`) and payload; nullptr if malformed */
+NBT* dh_nbt_read_node(bool named, const guint8*& pos, const guint8* end);
+/* Step over a payload of `type` without building nodes */
+bool dh_nbt_skip_payload(NBT_Tags type, const guint8*& pos, const guint8* end);
+
+/* Big-endian helpers shared by the other raw formats */
+void dh_nbt_put_be(std::vector<guint8>& out, guint64 val, int bytes);
+bool dh_nbt_get_be(const guint8*& pos, const guint8* end, int bytes, guint64& val);
+/* Strings hold at most 65535 bytes: a longer one is written empty and
+ * false is returned */
+bool dh_nbt_put_string(std::vector<guint8>& out, const char* str);
+
+#endif /* NBT_CODEC_HPP */
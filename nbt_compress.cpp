@@ -0,0 +1,483 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_compress.hpp"
+#include <cstring>
+
+/* libdeflate for whole buffers, zlib-ng or zlib for streams and, without
+ * libdeflate, for whole buffers too */
+#if defined(DH_NBT_HAVE_LIBDEFLATE)
+#include <libdeflate.h>
+#endif
+#if defined(DH_NBT_HAVE_ZLIB_NG)
+#include <zlib-ng.h>
+#define DH_Z(name) zng_##name
+typedef zng_stream dh_z_stream;
+#define DH_NBT_HAVE_Z_STREAM
+#elif defined(DH_NBT_HAVE_ZLIB)
+#include <zlib.h>
+#define DH_Z(name) name
+typedef z_stream dh_z_stream;
+#define DH_NBT_HAVE_Z_STREAM
+#endif
+
+#ifdef DH_NBT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+DhNbtCompression dh_nbt_detect_compression(const guint8* data, gsize len)
+{
+    if(len >= 2 && data[0] == 0x1f && data[1] == 0x8b)
+        return DH_COMPRESSION_GZIP;
+    if(len >= 4 && data[0] == 0x28 && data[1] == 0xb5 && data[2] == 0x2f && data[3] == 0xfd)
+        return DH_COMPRESSION_ZSTD;
+    if(len >= 2 && (data[0] & 0x0f) == 8 && ((data[0] << 8) | data[1]) % 31 == 0)
+        return DH_COMPRESSION_ZLIB;
+    return DH_COMPRESSION_NONE;
+}
+
+const char* dh_nbt_compression_backend(DhNbtCompression type)
+{
+    switch(type)
+    {
+        case DH_COMPRESSION_NONE:
+            return "none";
+        case DH_COMPRESSION_GZIP:
+        case DH_COMPRESSION_ZLIB:
+#if defined(DH_NBT_HAVE_LIBDEFLATE)
+            return "libdeflate";
+#elif defined(DH_NBT_HAVE_ZLIB_NG)
+            return "zlib-ng";
+#elif defined(DH_NBT_HAVE_ZLIB)
+            return "zlib";
+#else
+            return nullptr;
+#endif
+        case DH_COMPRESSION_ZSTD:
+#ifdef DH_NBT_HAVE_ZSTD
+            return "zstd";
+#else
+            return nullptr;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+bool dh_nbt_compression_available(DhNbtCompression type)
+{
+    return dh_nbt_compression_backend(type) != nullptr;
+}
+
+#if defined(DH_NBT_HAVE_LIBDEFLATE) || defined(DH_NBT_HAVE_ZLIB_NG) || defined(DH_NBT_HAVE_ZLIB)
+static bool is_gzip_member(const guint8* data, gsize len)
+{
+    return len >= 2 && data[0] == 0x1f && data[1] == 0x8b;
+}
+#endif
+
+#if defined(DH_NBT_HAVE_LIBDEFLATE) || defined(DH_NBT_HAVE_ZLIB_NG) || defined(DH_NBT_HAVE_ZLIB) || defined(DH_NBT_HAVE_ZSTD)
+/* Initial guess of the output size, exact for gzip */
+static gsize guess_size(const guint8* data, gsize len, DhNbtCompression type)
+{
+    if(type == DH_COMPRESSION_GZIP && len >= 18)
+    {
+        const guint8* isize = data + len - 4;
+        gsize size = isize[0] | (isize[1] << 8) | (isize[2] << 16) | ((guint32)isize[3] << 24);
+        if(size) return size;
+    }
+    return len * 4 + 64;
+}
+#endif
+
+#if defined(DH_NBT_HAVE_LIBDEFLATE)
+
+/* Allocating a compressor is not cheap, keep one per thread */
+struct DeflateContext
+{
+    libdeflate_compressor* compressor = nullptr;
+    int level = -1;
+    libdeflate_decompressor* decompressor = nullptr;
+    ~DeflateContext()
+    {
+        if(compressor) libdeflate_free_compressor(compressor);
+        if(decompressor) libdeflate_free_decompressor(decompressor);
+    }
+};
+
+static thread_local DeflateContext deflate_context;
+
+static bool deflate_compress(const guint8* data, gsize len, bool gzip, std::vector<guint8>& out, int level)
+{
+    if(level < 0) level = 6;
+    if(!deflate_context.compressor || deflate_context.level != level)
+    {
+        if(deflate_context.compressor) libdeflate_free_compressor(deflate_context.compressor);
+        deflate_context.compressor = libdeflate_alloc_compressor(level);
+        deflate_context.level = level;
+        if(!deflate_context.compressor) return false;
+    }
+    libdeflate_compressor* c = deflate_context.compressor;
+    gsize base = out.size();
+    out.resize(base + (gzip ? libdeflate_gzip_compress_bound(c, len) : libdeflate_zlib_compress_bound(c, len)));
+    size_t ret = gzip ? libdeflate_gzip_compress(c, data, len, out.data() + base, out.size() - base)
+                      : libdeflate_zlib_compress(c, data, len, out.data() + base, out.size() - base);
+    out.resize(base + ret);
+    return ret != 0;
+}
+
+static bool deflate_decompress(const guint8* data, gsize len, bool gzip, std::vector<guint8>& out)
+{
+    if(!deflate_context.decompressor)
+        deflate_context.decompressor = libdeflate_alloc_decompressor();
+    libdeflate_decompressor* d = deflate_context.decompressor;
+    if(!d) return false;
+    out.resize(guess_size(data, len, gzip ? DH_COMPRESSION_GZIP : DH_COMPRESSION_ZLIB));
+    gsize in_pos = 0;
+    gsize out_pos = 0;
+    while(out.size() < ((gsize)1 << 40))
+    {
+        size_t used = 0;
+        size_t actual = 0;
+        libdeflate_result ret = gzip
+            ? libdeflate_gzip_decompress_ex(d, data + in_pos, len - in_pos, out.data() + out_pos,
+                                            out.size() - out_pos, &used, &actual)
+            : libdeflate_zlib_decompress_ex(d, data + in_pos, len - in_pos, out.data() + out_pos,
+                                            out.size() - out_pos, &used, &actual);
+        if(ret == LIBDEFLATE_SUCCESS)
+        {
+            in_pos += used;
+            out_pos += actual;
+            /* Another gzip member follows */
+            if(gzip && is_gzip_member(data + in_pos, len - in_pos))
+                continue;
+            out.resize(out_pos);
+            return true;
+        }
+        else if(ret == LIBDEFLATE_INSUFFICIENT_SPACE)
+            out.resize(out.size() * 2);
+        else return false;
+    }
+    return false;
+}
+
+#elif defined(DH_NBT_HAVE_ZLIB_NG) || defined(DH_NBT_HAVE_ZLIB)
+
+static bool deflate_compress(const guint8* data, gsize len, bool gzip, std::vector<guint8>& out, int level)
+{
+    dh_z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(DH_Z(deflateInit2)(&stream, level < 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED,
+                          gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    gsize base = out.size();
+    out.resize(base + DH_Z(deflateBound)(&stream, len));
+    stream.next_in = (guint8*)data;
+    stream.avail_in = len;
+    stream.next_out = out.data() + base;
+    stream.avail_out = out.size() - base;
+    int ret = DH_Z(deflate)(&stream, Z_FINISH);
+    out.resize(base + stream.total_out);
+    DH_Z(deflateEnd)(&stream);
+    return ret == Z_STREAM_END;
+}
+
+static bool deflate_decompress(const guint8* data, gsize len, bool gzip, std::vector<guint8>& out)
+{
+    dh_z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    /* 32: detect gzip or zlib header */
+    if(DH_Z(inflateInit2)(&stream, 15 + 32) != Z_OK)
+        return false;
+    out.resize(guess_size(data, len, gzip ? DH_COMPRESSION_GZIP : DH_COMPRESSION_ZLIB));
+    stream.next_in = (guint8*)data;
+    stream.avail_in = len;
+    /* Output of the members before the current one */
+    gsize done = 0;
+    int ret = Z_OK;
+    while(ret == Z_OK)
+    {
+        if(done + stream.total_out == out.size())
+            out.resize(out.size() * 2);
+        stream.next_out = out.data() + done + stream.total_out;
+        stream.avail_out = out.size() - done - stream.total_out;
+        ret = DH_Z(inflate)(&stream, Z_NO_FLUSH);
+        if(ret == Z_BUF_ERROR && stream.avail_out == 0)
+            ret = Z_OK;
+        /* Another gzip member follows */
+        if(ret == Z_STREAM_END && gzip && is_gzip_member(stream.next_in, stream.avail_in))
+        {
+            done += stream.total_out;
+            ret = DH_Z(inflateReset)(&stream);
+        }
+    }
+    out.resize(done + stream.total_out);
+    DH_Z(inflateEnd)(&stream);
+    return ret == Z_STREAM_END;
+}
+
+#endif
+
+#ifdef DH_NBT_HAVE_ZSTD
+
+static bool zstd_compress(const guint8* data, gsize len, std::vector<guint8>& out, int level)
+{
+    gsize base = out.size();
+    out.resize(base + ZSTD_compressBound(len));
+    size_t ret = ZSTD_compress(out.data() + base, out.size() - base, data, len, level < 0 ? 3 : level);
+    if(ZSTD_isError(ret)) return false;
+    out.resize(base + ret);
+    return true;
+}
+
+/* Largest buffer taken from a frame header before any output is seen */
+static const gsize zstd_trusted_size = (gsize)1 << 26;
+
+static bool zstd_decompress(const guint8* data, gsize len, std::vector<guint8>& out)
+{
+    unsigned long long size = ZSTD_getFrameContentSize(data, len);
+    if(size == ZSTD_CONTENTSIZE_ERROR) return false;
+    /* The header is only a hint: capped, and later frames may follow */
+    gsize guess = guess_size(data, len, DH_COMPRESSION_ZSTD);
+    if(size != ZSTD_CONTENTSIZE_UNKNOWN)
+        guess = size ? MIN((gsize)size, zstd_trusted_size) : 64;
+
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    if(!stream) return false;
+    ZSTD_initDStream(stream);
+    ZSTD_inBuffer in = { data, len, 0 };
+    out.resize(guess);
+    size_t written = 0;
+    size_t ret = 1;
+    /* ret is 0 at the end of each frame */
+    while((ret != 0 || in.pos < in.size) && !ZSTD_isError(ret) && out.size() < ((gsize)1 << 40))
+    {
+        if(written == out.size())
+            out.resize(out.size() * 2);
+        ZSTD_outBuffer o = { out.data() + written, out.size() - written, 0 };
+        ret = ZSTD_decompressStream(stream, &o, &in);
+        written += o.pos;
+        if(in.pos == in.size && o.pos < o.size && ret != 0)
+            break; /* Truncated */
+    }
+    ZSTD_freeDStream(stream);
+    out.resize(written);
+    return ret == 0 && in.pos == in.size;
+}
+
+#endif
+
+bool dh_nbt_compress(const guint8* data, gsize len, DhNbtCompression type,
+                     std::vector<guint8>& out, int level)
+{
+    (void)level; /* Unused without any backend */
+    out.clear();
+    switch(type)
+    {
+        case DH_COMPRESSION_NONE:
+            out.assign(data, data + len);
+            return true;
+#if defined(DH_NBT_HAVE_LIBDEFLATE) || defined(DH_NBT_HAVE_ZLIB_NG) || defined(DH_NBT_HAVE_ZLIB)
+        case DH_COMPRESSION_GZIP:
+            return deflate_compress(data, len, true, out, level);
+        case DH_COMPRESSION_ZLIB:
+            return deflate_compress(data, len, false, out, level);
+#endif
+#ifdef DH_NBT_HAVE_ZSTD
+        case DH_COMPRESSION_ZSTD:
+            return zstd_compress(data, len, out, level);
+#endif
+        default:
+            return false;
+    }
+}
+
+bool dh_nbt_decompress(const guint8* data, gsize len, DhNbtCompression type,
+                       std::vector<guint8>& out)
+{
+    if(type == DH_COMPRESSION_AUTO)
+        type = dh_nbt_detect_compression(data, len);
+    switch(type)
+    {
+        case DH_COMPRESSION_NONE:
+            out.assign(data, data + len);
+            return true;
+#if defined(DH_NBT_HAVE_LIBDEFLATE) || defined(DH_NBT_HAVE_ZLIB_NG) || defined(DH_NBT_HAVE_ZLIB)
+        case DH_COMPRESSION_GZIP:
+            return deflate_decompress(data, len, true, out);
+        case DH_COMPRESSION_ZLIB:
+            return deflate_decompress(data, len, false, out);
+#endif
+#ifdef DH_NBT_HAVE_ZSTD
+        case DH_COMPRESSION_ZSTD:
+            return zstd_decompress(data, len, out);
+#endif
+        default:
+            return false;
+    }
+}
+
+/* Output is produced in steps of this size */
+static const gsize stream_chunk = 1 << 16;
+
+#ifdef DH_NBT_HAVE_Z_STREAM
+
+static bool z_stream_run(dh_z_stream* stream, const guint8* data, gsize len, int flush,
+                         std::vector<guint8>& out)
+{
+    stream->next_in = (guint8*)data;
+    stream->avail_in = len;
+    int ret = Z_OK;
+    do
+    {
+        gsize base = out.size();
+        out.resize(base + stream_chunk);
+        stream->next_out = out.data() + base;
+        stream->avail_out = stream_chunk;
+        ret = DH_Z(deflate)(stream, flush);
+        out.resize(base + stream_chunk - stream->avail_out);
+        if(ret == Z_STREAM_ERROR) return false;
+    }
+    while(stream->avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    return true;
+}
+
+#endif
+
+#ifdef DH_NBT_HAVE_ZSTD
+
+static bool zstd_stream_run(ZSTD_CStream* stream, const guint8* data, gsize len,
+                            ZSTD_EndDirective mode, std::vector<guint8>& out)
+{
+    ZSTD_inBuffer in = { data, len, 0 };
+    size_t ret = 0;
+    do
+    {
+        gsize base = out.size();
+        out.resize(base + stream_chunk);
+        ZSTD_outBuffer o = { out.data() + base, stream_chunk, 0 };
+        ret = ZSTD_compressStream2(stream, &o, &in, mode);
+        out.resize(base + o.pos);
+        if(ZSTD_isError(ret)) return false;
+    }
+    while(mode == ZSTD_e_end ? ret != 0 : in.pos < in.size);
+    return true;
+}
+
+#endif
+
+DhNbtCompressStream::DhNbtCompressStream(DhNbtCompression type, int level)
+{
+    this->type = type;
+    this->level = level;
+    state = nullptr;
+    switch(type)
+    {
+        case DH_COMPRESSION_NONE:
+            valid = true;
+            break;
+#ifdef DH_NBT_HAVE_Z_STREAM
+        /* libdeflate cannot stream, without zlib these are not valid */
+        case DH_COMPRESSION_GZIP:
+        case DH_COMPRESSION_ZLIB:
+        {
+            dh_z_stream* stream = new dh_z_stream;
+            memset(stream, 0, sizeof(*stream));
+            valid = DH_Z(deflateInit2)(stream, level < 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED,
+                                       type == DH_COMPRESSION_GZIP ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+            if(valid) state = stream;
+            else delete stream;
+            break;
+        }
+#endif
+#ifdef DH_NBT_HAVE_ZSTD
+        case DH_COMPRESSION_ZSTD:
+        {
+            ZSTD_CStream* stream = ZSTD_createCStream();
+            valid = stream && !ZSTD_isError(ZSTD_initCStream(stream, level < 0 ? 3 : level));
+            if(valid) state = stream;
+            else if(stream) ZSTD_freeCStream(stream);
+            break;
+        }
+#endif
+        default:
+            valid = false;
+            break;
+    }
+}
+
+DhNbtCompressStream::~DhNbtCompressStream()
+{
+    if(!state) return;
+#ifdef DH_NBT_HAVE_Z_STREAM
+    if(type == DH_COMPRESSION_GZIP || type == DH_COMPRESSION_ZLIB)
+    {
+        DH_Z(deflateEnd)((dh_z_stream*)state);
+        delete (dh_z_stream*)state;
+    }
+#endif
+#ifdef DH_NBT_HAVE_ZSTD
+    if(type == DH_COMPRESSION_ZSTD)
+        ZSTD_freeCStream((ZSTD_CStream*)state);
+#endif
+}
+
+bool DhNbtCompressStream::write(const guint8* data, gsize len, std::vector<guint8>& out)
+{
+    if(!valid) return false;
+    if(!len) return true;
+    switch(type)
+    {
+        case DH_COMPRESSION_NONE:
+            out.insert(out.end(), data, data + len);
+            return true;
+#ifdef DH_NBT_HAVE_Z_STREAM
+        case DH_COMPRESSION_GZIP:
+        case DH_COMPRESSION_ZLIB:
+            return z_stream_run((dh_z_stream*)state, data, len, Z_NO_FLUSH, out);
+#endif
+#ifdef DH_NBT_HAVE_ZSTD
+        case DH_COMPRESSION_ZSTD:
+            return zstd_stream_run((ZSTD_CStream*)state, data, len, ZSTD_e_continue, out);
+#endif
+        default:
+            return false;
+    }
+}
+
+bool DhNbtCompressStream::finish(std::vector<guint8>& out)
+{
+    (void)out; /* Unused without any backend */
+    if(!valid) return false;
+    valid = false;
+    switch(type)
+    {
+        case DH_COMPRESSION_NONE:
+            return true;
+#ifdef DH_NBT_HAVE_Z_STREAM
+        case DH_COMPRESSION_GZIP:
+        case DH_COMPRESSION_ZLIB:
+            return z_stream_run((dh_z_stream*)state, nullptr, 0, Z_FINISH, out);
+#endif
+#ifdef DH_NBT_HAVE_ZSTD
+        case DH_COMPRESSION_ZSTD:
+            return zstd_stream_run((ZSTD_CStream*)state, nullptr, 0, ZSTD_e_end, out);
+#endif
+        default:
+            return false;
+    }
+}
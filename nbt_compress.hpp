@@ -0,0 +1,72 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_COMPRESS_HPP
+#define NBT_COMPRESS_HPP
+
+#include <glib.h>
+
+typedef enum {
+    DH_COMPRESSION_AUTO, DH_COMPRESSION_NONE, DH_COMPRESSION_GZIP, DH_COMPRESSION_ZLIB, DH_COMPRESSION_ZSTD} DhNbtCompression;
+
+#ifdef __cplusplus
+#include <vector>
+
+/* Backends are picked at build time: libdeflate, then zlib-ng, then zlib
+ * for GZIP/ZLIB, and libzstd for ZSTD. Without a deflate backend, GZIP
+ * and ZLIB are still handled by libnbt itself in load and save. */
+
+/* Guess from the magic bytes, never returns DH_COMPRESSION_AUTO */
+DhNbtCompression dh_nbt_detect_compression(const guint8* data, gsize len);
+/* Whether dh_nbt_compress/dh_nbt_decompress can handle `type` */
+bool dh_nbt_compression_available(DhNbtCompression type);
+/* Name of the backend for `type`, or nullptr if none */
+const char* dh_nbt_compression_backend(DhNbtCompression type);
+
+/* `level` < 0 selects the backend default */
+bool dh_nbt_compress(const guint8* data, gsize len, DhNbtCompression type,
+                     std::vector<guint8>& out, int level = -1);
+/* DH_COMPRESSION_AUTO detects the format */
+bool dh_nbt_decompress(const guint8* data, gsize len, DhNbtCompression type,
+                       std::vector<guint8>& out);
+
+/* Incremental compression, the memory used does not grow with the
+ * input. Compressed bytes are appended to `out`, which is never cleared.
+ * GZIP and ZLIB need zlib-ng or zlib, as libdeflate cannot stream: with
+ * libdeflate alone the stream is not valid. */
+class DhNbtCompressStream
+{
+public:
+  DhNbtCompressStream(DhNbtCompression type, int level = -1);
+  DhNbtCompressStream(const DhNbtCompressStream&) = delete;
+  ~DhNbtCompressStream();
+
+  bool is_valid() { return valid; }
+  bool write(const guint8* data, gsize len, std::vector<guint8>& out);
+  /* End the stream, nothing can be written after it */
+  bool finish(std::vector<guint8>& out);
+
+private:
+  DhNbtCompression type;
+  int level;
+  void* state;
+  bool valid;
+};
+
+#endif
+
+#endif /* NBT_COMPRESS_HPP */
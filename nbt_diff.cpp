@@ -0,0 +1,514 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_diff.hpp"
+#include "nbt_codec.hpp"
+#include "nbt_stats.hpp"
+#include <cstring>
+#include <unordered_map>
+
+/* Patch format: "DHNP", version byte, varint op count, then per op
+ * an op byte, varint step count, the steps and (SET/INSERT) the value */
+static const guint8 patch_magic[] = { 'D', 'H', 'N', 'P', 1 };
+
+static void put_varint(std::vector<guint8>& out, guint64 val)
+{
+    while(val >= 0x80)
+    {
+        out.push_back((guint8)(val | 0x80));
+        val >>= 7;
+    }
+    out.push_back((guint8)val);
+}
+
+static bool get_varint(const guint8*& pos, const guint8* end, guint64& val)
+{
+    val = 0;
+    for(int shift = 0 ; pos < end && shift < 64 ; shift += 7)
+    {
+        guint8 byte = *pos++;
+        val |= (guint64)(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static int child_count(NBT* node)
+{
+    int ret = 0;
+    for(NBT* child = node->child ; child ; child = child->next)
+        ret++;
+    return ret;
+}
+
+static bool same_value(NBT* a, NBT* b)
+{
+    switch(a->type)
+    {
+        case TAG_Byte:
+        case TAG_Short:
+        case TAG_Int:
+        case TAG_Long:
+            return a->value_i == b->value_i;
+        case TAG_Float:
+        case TAG_Double:
+            return !memcmp(&a->value_d, &b->value_d, sizeof(double));
+        case TAG_String:
+            return !strcmp((const char*)a->value_a.value, (const char*)b->value_a.value);
+        case TAG_Byte_Array:
+        case TAG_Int_Array:
+        case TAG_Long_Array:
+        {
+            if(a->value_a.len != b->value_a.len) return false;
+            int width = a->type == TAG_Byte_Array ? 1 : (a->type == TAG_Int_Array ? 4 : 8);
+            return !memcmp(a->value_a.value, b->value_a.value, (size_t)a->value_a.len * width);
+        }
+        default:
+            return true;
+    }
+}
+
+/* Identity of a list element, empty if it has none */
+static std::string element_id(NBT* node, const std::string& id_key, DhNbtFreezeRoot* frozen)
+{
+    if(node->type != TAG_Compound) return std::string();
+    NBT* copy = dh_nbt_frozen_copy(frozen, node);
+    std::string ret;
+    for(NBT* child = copy ? copy->child : node->child ; child ; child = child->next)
+    {
+        if(!child->key || id_key != child->key) continue;
+        if(child->type == TAG_String)
+            ret = "s" + std::string((const char*)child->value_a.value);
+        else if(child->type >= TAG_Byte && child->type <= TAG_Long)
+            ret = "i" + std::to_string(child->value_i);
+        break;
+    }
+    if(copy) dh_nbt_free(copy);
+    return ret;
+}
+
+void DhNbtPatch::push_op(DhNbtPatchOpType type, std::vector<DhNbtPathStep>& path, NBT* value)
+{
+    DhNbtPatchOp op;
+    op.type = type;
+    op.path = path;
+    if(value) dh_nbt_write_node(value, false, op.value, to_frozen);
+    ops.push_back(std::move(op));
+}
+
+DhNbtPatch DhNbtPatch::diff(DhNbtInstance from, DhNbtInstance to, const char* list_id_key)
+{
+    DhNbtPatch patch;
+    if(list_id_key) patch.list_id_key = list_id_key;
+    std::vector<DhNbtPathStep> path;
+    NBT* from_node = from.get_current_nbt();
+    NBT* to_node = to.get_current_nbt();
+    patch.from_frozen = from.get_freeze_root();
+    patch.to_frozen = to.get_freeze_root();
+    if(from_node && to_node)
+        patch.diff_node(from_node, to_node, path);
+    else if(to_node)
+        patch.push_op(DH_PATCH_SET, path, to_node);
+    patch.from_frozen = nullptr;
+    patch.to_frozen = nullptr;
+    return patch;
+}
+
+void DhNbtPatch::diff_node(NBT* from, NBT* to, std::vector<DhNbtPathStep>& path)
+{
+    /* Frozen subtrees are compared through copies, the trees stay as they are */
+    NBT* from_copy = dh_nbt_frozen_copy(from_frozen, from);
+    NBT* to_copy = dh_nbt_frozen_copy(to_frozen, to);
+    if(from_copy) from = from_copy;
+    if(to_copy) to = to_copy;
+    if(from->type != to->type)
+        push_op(DH_PATCH_SET, path, to);
+    else if(from->type == TAG_Compound)
+        diff_compound(from, to, path);
+    else if(from->type == TAG_List)
+    {
+        /* A list can not hold two element types, replace it as a whole */
+        if(from->child && to->child && from->child->type != to->child->type)
+            push_op(DH_PATCH_SET, path, to);
+        else diff_list(from, to, path);
+    }
+    else if(!same_value(from, to))
+        push_op(DH_PATCH_SET, path, to);
+    if(from_copy) dh_nbt_free(from_copy);
+    if(to_copy) dh_nbt_free(to_copy);
+}
+
+void DhNbtPatch::diff_compound(NBT* from, NBT* to, std::vector<DhNbtPathStep>& path)
+{
+    std::unordered_map<std::string, NBT*> from_map;
+    std::unordered_map<std::string, NBT*> to_map;
+    for(NBT* child = from->child ; child ; child = child->next)
+        from_map.emplace(child->key ? child->key : "", child);
+    for(NBT* child = to->child ; child ; child = child->next)
+        to_map.emplace(child->key ? child->key : "", child);
+
+    for(NBT* child = from->child ; child ; child = child->next)
+    {
+        std::string key = child->key ? child->key : "";
+        if(from_map[key] != child) continue; /* Duplicated key */
+        path.push_back({ key, -1 });
+        auto it = to_map.find(key);
+        if(it == to_map.end())
+            push_op(DH_PATCH_REMOVE, path, nullptr);
+        else diff_node(child, it->second, path);
+        path.pop_back();
+    }
+    for(NBT* child = to->child ; child ; child = child->next)
+    {
+        std::string key = child->key ? child->key : "";
+        if(to_map[key] != child || from_map.count(key)) continue;
+        path.push_back({ key, -1 });
+        push_op(DH_PATCH_INSERT, path, child);
+        path.pop_back();
+    }
+}
+
+void DhNbtPatch::diff_list(NBT* from, NBT* to, std::vector<DhNbtPathStep>& path)
+{
+    if(!list_id_key.empty() && diff_list_by_id(from, to, path))
+        return;
+
+    NBT* from_child = from->child;
+    NBT* to_child = to->child;
+    int index = 0;
+    for(; from_child && to_child ; from_child = from_child->next, to_child = to_child->next, index++)
+    {
+        path.push_back({ std::string(), index });
+        diff_node(from_child, to_child, path);
+        path.pop_back();
+    }
+    /* Remove from the tail so that indexes stay valid */
+    for(int i = child_count(from) - 1 ; i >= index ; i--)
+    {
+        path.push_back({ std::string(), i });
+        push_op(DH_PATCH_REMOVE, path, nullptr);
+        path.pop_back();
+    }
+    for(; to_child ; to_child = to_child->next, index++)
+    {
+        path.push_back({ std::string(), index });
+        push_op(DH_PATCH_INSERT, path, to_child);
+        path.pop_back();
+    }
+}
+
+bool DhNbtPatch::diff_list_by_id(NBT* from, NBT* to, std::vector<DhNbtPathStep>& path)
+{
+    std::vector<NBT*> from_nodes;
+    std::vector<NBT*> to_nodes;
+    std::vector<std::string> from_ids;
+    std::vector<std::string> to_ids;
+    std::unordered_map<std::string, int> from_map;
+    std::unordered_map<std::string, int> to_map;
+
+    for(NBT* child = from->child ; child ; child = child->next)
+    {
+        std::string id = element_id(child, list_id_key, from_frozen);
+        if(id.empty() || !from_map.emplace(id, from_nodes.size()).second)
+            return false;
+        from_nodes.push_back(child);
+        from_ids.push_back(id);
+    }
+    for(NBT* child = to->child ; child ; child = child->next)
+    {
+        std::string id = element_id(child, list_id_key, to_frozen);
+        if(id.empty() || !to_map.emplace(id, to_nodes.size()).second)
+            return false;
+        to_nodes.push_back(child);
+        to_ids.push_back(id);
+    }
+
+    /* Matched elements must keep their relative order, otherwise
+     * fall back to the positional diff */
+    std::vector<std::string> kept_from;
+    std::vector<std::string> kept_to;
+    for(auto& id : from_ids)
+        if(to_map.count(id)) kept_from.push_back(id);
+    for(auto& id : to_ids)
+        if(from_map.count(id)) kept_to.push_back(id);
+    if(kept_from != kept_to) return false;
+
+    for(int i = (int)from_ids.size() - 1 ; i >= 0 ; i--)
+    {
+        if(to_map.count(from_ids[i])) continue;
+        path.push_back({ std::string(), i });
+        push_op(DH_PATCH_REMOVE, path, nullptr);
+        path.pop_back();
+    }
+    for(size_t i = 0 ; i < to_ids.size() ; i++)
+    {
+        if(from_map.count(to_ids[i])) continue;
+        path.push_back({ std::string(), (int)i });
+        push_op(DH_PATCH_INSERT, path, to_nodes[i]);
+        path.pop_back();
+    }
+    for(size_t i = 0 ; i < to_ids.size() ; i++)
+    {
+        auto it = from_map.find(to_ids[i]);
+        if(it == from_map.end()) continue;
+        path.push_back({ std::string(), (int)i });
+        diff_node(from_nodes[it->second], to_nodes[i], path);
+        path.pop_back();
+    }
+    return true;
+}
+
+std::vector<guint8> DhNbtPatch::serialize()
+{
+    std::vector<guint8> out(patch_magic, patch_magic + sizeof(patch_magic));
+    put_varint(out, ops.size());
+    for(auto& op : ops)
+    {
+        out.push_back(op.type);
+        put_varint(out, op.path.size());
+        for(auto& step : op.path)
+        {
+            if(step.index < 0)
+            {
+                out.push_back(0);
+                dh_nbt_put_string(out, step.key.c_str());
+            }
+            else
+            {
+                out.push_back(1);
+                put_varint(out, step.index);
+            }
+        }
+        if(op.type != DH_PATCH_REMOVE)
+        {
+            put_varint(out, op.value.size());
+            out.insert(out.end(), op.value.begin(), op.value.end());
+        }
+    }
+    return out;
+}
+
+DhNbtPatch DhNbtPatch::deserialize(const guint8* data, gsize len)
+{
+    DhNbtPatch patch;
+    const guint8* pos = data;
+    const guint8* end = data + len;
+    guint64 count = 0;
+    if(len < sizeof(patch_magic) || memcmp(data, patch_magic, sizeof(patch_magic)))
+        return patch;
+    pos += sizeof(patch_magic);
+    if(!get_varint(pos, end, count)) return patch;
+
+    for(guint64 i = 0 ; i < count ; i++)
+    {
+        DhNbtPatchOp op;
+        guint64 steps = 0;
+        if(pos >= end || *pos > DH_PATCH_REMOVE) return DhNbtPatch();
+        op.type = (DhNbtPatchOpType)*pos++;
+        if(!get_varint(pos, end, steps)) return DhNbtPatch();
+        for(guint64 j = 0 ; j < steps ; j++)
+        {
+            DhNbtPathStep step;
+            guint64 val = 0;
+            if(pos >= end) return DhNbtPatch();
+            if(*pos++ == 0)
+            {
+                if(!dh_nbt_get_be(pos, end, 2, val) || (guint64)(end - pos) < val)
+                    return DhNbtPatch();
+                step.key.assign((const char*)pos, val);
+                pos += val;
+            }
+            else
+            {
+                if(!get_varint(pos, end, val) || val > G_MAXINT) return DhNbtPatch();
+                step.index = val;
+            }
+            op.path.push_back(std::move(step));
+        }
+        if(op.type != DH_PATCH_REMOVE)
+        {
+            guint64 size = 0;
+            if(!get_varint(pos, end, size) || (guint64)(end - pos) < size)
+                return DhNbtPatch();
+            op.value.assign(pos, pos + size);
+            pos += size;
+        }
+        patch.ops.push_back(std::move(op));
+    }
+    return patch;
+}
+
+static bool descend(DhNbtInstance& instance, const DhNbtPathStep& step)
+{
+    if(step.index < 0)
+        return instance.child(step.key.c_str());
+    else if(step.index < instance.child_value())
+        return instance.child(step.index);
+    else return false;
+}
+
+static bool remove_step(DhNbtInstance& parent, const DhNbtPathStep& step)
+{
+    if(step.index < 0)
+        return parent.rm_node(step.key.c_str());
+    else return parent.rm_node(step.index);
+}
+
+/* Give `target` the type and value of `node`, keeping its key, its
+ * siblings and its owner; `node` is freed with the old content */
+static void replace_content(DhNbtFreezeRoot* frozen, NBT* target, NBT* node)
+{
+    dh_nbt_freeze_forget(frozen, target);
+    NBT old = *target;
+    *target = *node;
+    *node = old;
+    std::swap(target->key, node->key);
+    std::swap(target->next, node->next);
+    std::swap(target->prev, node->prev);
+    dh_nbt_free(node);
+}
+
+/* Decode the value of a SET or INSERT, which must use all of its bytes */
+static NBT* read_value(const DhNbtPatchOp& op)
+{
+    const guint8* pos = op.value.data();
+    const guint8* end = pos + op.value.size();
+    NBT* node = dh_nbt_read_node(false, pos, end);
+    if(node && pos != end)
+    {
+        dh_nbt_free(node);
+        return nullptr;
+    }
+    return node;
+}
+
+/* Apply one op, taking `node` (freed on failure). On success the op
+ * undoing it is appended to `undo` if given. */
+static bool apply_op(DhNbtInstance& root, const DhNbtPatchOp& op, NBT* node,
+                     std::vector<DhNbtPatchOp>* undo)
+{
+    DhNbtPatchOp reverse;
+    reverse.path = op.path;
+    if(op.path.empty())
+    {
+        if(op.type != DH_PATCH_SET)
+        {
+            if(node) dh_nbt_free(node);
+            return false;
+        }
+        reverse.type = DH_PATCH_SET;
+        if(undo)
+            dh_nbt_write_node(root.get_current_nbt(), false, reverse.value, root.get_freeze_root());
+        replace_content(root.get_freeze_root(), root.get_current_nbt(), node);
+        if(undo) undo->push_back(std::move(reverse));
+        return true;
+    }
+
+    DhNbtInstance parent(root);
+    bool found = true;
+    for(size_t i = 0 ; i + 1 < op.path.size() && found ; i++)
+        found = descend(parent, op.path[i]);
+    if(!found)
+    {
+        if(node) dh_nbt_free(node);
+        return false;
+    }
+
+    const DhNbtPathStep& last = op.path.back();
+    if(node && last.index < 0)
+        node->key = strdup(last.key.c_str());
+    DhNbtInstance node_instance(node, true);
+    bool ret = false;
+    switch(op.type)
+    {
+        case DH_PATCH_SET:
+        {
+            DhNbtInstance target(parent);
+            if(!descend(target, last))
+            {
+                dh_nbt_free(node);
+                break;
+            }
+            reverse.type = DH_PATCH_SET;
+            if(undo)
+                dh_nbt_write_node(target.get_current_nbt(), false, reverse.value, root.get_freeze_root());
+            /* The new node goes right after the old one, which is
+             * then the first match for its key or keeps its index */
+            if(parent.insert_after(target, node_instance))
+                ret = remove_step(parent, last);
+            else dh_nbt_free(node);
+            break;
+        }
+        case DH_PATCH_INSERT:
+        {
+            DhNbtInstance sibling;
+            reverse.type = DH_PATCH_REMOVE;
+            if(!parent.is_type(DH_TYPE_Compound) && !parent.is_type(DH_TYPE_List))
+            {
+                dh_nbt_free(node);
+                break;
+            }
+            if(last.index >= 0 && last.index < parent.child_value())
+            {
+                sibling = parent;
+                sibling.child(last.index);
+            }
+            if(last.index <= parent.child_value())
+                ret = parent.insert_before(sibling, node_instance);
+            if(!ret) dh_nbt_free(node);
+            break;
+        }
+        case DH_PATCH_REMOVE:
+        {
+            DhNbtInstance target(parent);
+            if(!descend(target, last)) break;
+            reverse.type = DH_PATCH_INSERT;
+            if(undo)
+                dh_nbt_write_node(target.get_current_nbt(), false, reverse.value, root.get_freeze_root());
+            ret = remove_step(parent, last);
+            break;
+        }
+    }
+    if(ret && undo) undo->push_back(std::move(reverse));
+    return ret;
+}
+
+bool DhNbtPatch::apply(DhNbtInstance& root)
+{
+    if(!root.is_non_null()) return false;
+    /* Every value is decoded before the tree is touched */
+    std::vector<NBT*> nodes(ops.size(), nullptr);
+    bool ret = true;
+    for(size_t i = 0 ; i < ops.size() && ret ; i++)
+        if(ops[i].type != DH_PATCH_REMOVE)
+            ret = (nodes[i] = read_value(ops[i])) != nullptr;
+
+    std::vector<DhNbtPatchOp> undo;
+    for(size_t i = 0 ; i < ops.size() && ret ; i++)
+    {
+        ret = apply_op(root, ops[i], nodes[i], &undo);
+        nodes[i] = nullptr;
+    }
+    for(NBT* node : nodes)
+        if(node) dh_nbt_free(node);
+    if(ret) return true;
+
+    /* A path did not resolve: undo the ops already applied, latest first */
+    for(auto it = undo.rbegin() ; it != undo.rend() ; ++it)
+        apply_op(root, *it, it->type != DH_PATCH_REMOVE ? read_value(*it) : nullptr, nullptr);
+    return false;
+}
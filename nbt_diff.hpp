@@ -0,0 +1,83 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_DIFF_HPP
+#define NBT_DIFF_HPP
+
+#include "nbt_interface.hpp"
+#include <string>
+
+typedef enum {
+    DH_PATCH_SET, DH_PATCH_INSERT, DH_PATCH_REMOVE} DhNbtPatchOpType;
+
+/* One step of a path: a compound key, or a list index if `key` is empty */
+struct DhNbtPathStep
+{
+    std::string key;
+    int index = -1;
+};
+
+struct DhNbtPatchOp
+{
+    DhNbtPatchOpType type;
+    std::vector<DhNbtPathStep> path;
+    /* Raw tagged node for SET and INSERT (type byte + payload) */
+    std::vector<guint8> value;
+};
+
+class DhNbtPatch
+{
+public:
+  DhNbtPatch() {};
+
+  /* Compare the current nodes of two instances. Compounds are matched
+   * by key, lists by position, or by the value of `list_id_key` in
+   * compound elements if given. Paths are relative to those nodes.
+   * Frozen subtrees are compared through decoded copies. */
+  static DhNbtPatch diff(DhNbtInstance from, DhNbtInstance to, const char* list_id_key = nullptr);
+  /* Returns an empty patch if `data` is malformed */
+  static DhNbtPatch deserialize(const guint8* data, gsize len);
+
+  std::vector<guint8> serialize();
+  /* Apply in place with the mutators of DhNbtInstance, resolving the
+   * paths from the current node of `root`. A SET on that node itself
+   * replaces its content, keeping its key and its place in the tree.
+   * Frozen subtrees on the paths are thawed. `root` dangles if its
+   * node is inside a subtree later frozen or collected.
+   * Values are all decoded first, and if a path does not resolve the
+   * ops already applied are undone: on false the content is as before,
+   * though compound entries may come back in another order. */
+  bool apply(DhNbtInstance& root);
+
+  bool is_empty() { return ops.empty(); }
+  const std::vector<DhNbtPatchOp>& get_ops() { return ops; }
+
+private:
+  std::vector<DhNbtPatchOp> ops;
+  std::string list_id_key;
+  /* Tables of the roots being compared, during diff() */
+  DhNbtFreezeRoot* from_frozen = nullptr;
+  DhNbtFreezeRoot* to_frozen = nullptr;
+
+  void diff_node(NBT* from, NBT* to, std::vector<DhNbtPathStep>& path);
+  void diff_compound(NBT* from, NBT* to, std::vector<DhNbtPathStep>& path);
+  void diff_list(NBT* from, NBT* to, std::vector<DhNbtPathStep>& path);
+  bool diff_list_by_id(NBT* from, NBT* to, std::vector<DhNbtPathStep>& path);
+  void push_op(DhNbtPatchOpType type, std::vector<DhNbtPathStep>& path, NBT* value);
+};
+
+#endif /* NBT_DIFF_HPP */
@@ -0,0 +1,415 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_interface.hpp"
+#include "nbt_codec.hpp"
+#include "nbt_freeze.hpp"
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+struct FrozenNode
+{
+    NBT_Tags type;
+    DhNbtCompression compression;
+    /* Payload of the node, empty while thawed */
+    std::vector<guint8> blob;
+    /* Estimated memory of the children */
+    gsize live_bytes;
+    bool thawed;
+    std::list<NBT*>::iterator lru;
+};
+
+class DhNbtFreezeRoot
+{
+public:
+  DhNbtFreezeRoot(NBT* root) : root(root) {}
+
+  NBT* root;
+  std::mutex lock;
+  std::unordered_map<NBT*, FrozenNode> entries;
+  /* Thawed subtrees, most recently entered first */
+  std::list<NBT*> lru;
+  gsize budget = 0;
+  DhNbtFreezeStats stats = {};
+  /* stats.frozen and stats.thawed, read without the lock by child() */
+  std::atomic<guint64> frozen_now{0};
+  std::atomic<guint64> thawed_now{0};
+};
+
+typedef std::unordered_map<NBT*, FrozenNode>::iterator EntryIter;
+
+std::shared_ptr<DhNbtFreezeRoot> dh_nbt_freeze_root_new(NBT* root)
+{
+    return std::make_shared<DhNbtFreezeRoot>(root);
+}
+
+static bool is_container(NBT* node)
+{
+    return node->type == TAG_List || node->type == TAG_Compound;
+}
+
+static void publish_counts(DhNbtFreezeRoot* frozen)
+{
+    frozen->frozen_now.store(frozen->stats.frozen, std::memory_order_relaxed);
+    frozen->thawed_now.store(frozen->stats.thawed, std::memory_order_relaxed);
+}
+
+/* Take the entry out of the table and the accounting */
+static void drop_entry(DhNbtFreezeRoot* frozen, EntryIter it)
+{
+    FrozenNode& entry = it->second;
+    DhNbtFreezeStats& stats = frozen->stats;
+    if(entry.thawed)
+    {
+        frozen->lru.erase(entry.lru);
+        stats.thawed--;
+        stats.thawed_bytes -= entry.live_bytes;
+    }
+    else
+    {
+        stats.frozen--;
+        stats.blob_bytes -= entry.blob.size();
+        stats.saved_bytes -= entry.live_bytes - entry.blob.size();
+    }
+    frozen->entries.erase(it);
+    publish_counts(frozen);
+}
+
+/* Every path freeing a node of the tree drops its entry first, so an
+ * entry always belongs to the node at its address */
+static FrozenNode* find_entry(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    auto it = frozen->entries.find(node);
+    return it == frozen->entries.end() ? nullptr : &it->second;
+}
+
+/* Heap memory of the children of `node` as libnbt allocates them,
+ * frozen subtrees counted as if resident */
+static gsize children_bytes(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    gsize ret = 0;
+    if(!node->child)
+    {
+        FrozenNode* entry = find_entry(frozen, node);
+        if(entry && !entry->thawed) return entry->live_bytes;
+    }
+    for(NBT* child = node->child ; child ; child = child->next)
+    {
+        ret += sizeof(NBT);
+        if(child->key) ret += strlen(child->key) + 1;
+        switch(child->type)
+        {
+            case TAG_String:
+            case TAG_Byte_Array:
+                ret += child->value_a.len;
+                break;
+            case TAG_Int_Array:
+                ret += (gsize)child->value_a.len * 4;
+                break;
+            case TAG_Long_Array:
+                ret += (gsize)child->value_a.len * 8;
+                break;
+            case TAG_List:
+            case TAG_Compound:
+                ret += children_bytes(frozen, child);
+                break;
+            default:
+                break;
+        }
+    }
+    return ret;
+}
+
+static void forget_locked(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    if(!is_container(node)) return;
+    auto it = frozen->entries.find(node);
+    if(it != frozen->entries.end()) drop_entry(frozen, it);
+    for(NBT* child = node->child ; child ; child = child->next)
+        forget_locked(frozen, child);
+}
+
+static bool freeze_node(DhNbtFreezeRoot* frozen, NBT* node, DhNbtCompression compression)
+{
+    /* Frozen subtrees inside are part of the blob */
+    std::vector<guint8> raw;
+    dh_nbt_write_payload(node, raw, frozen);
+    std::vector<guint8> blob;
+    if(compression == DH_COMPRESSION_NONE) blob.swap(raw);
+    else if(!dh_nbt_compress(raw.data(), raw.size(), compression, blob)) return false;
+
+    NBT* child = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(frozen->lock);
+        gsize live = children_bytes(frozen, node);
+        if(blob.size() >= live) return false;
+        blob.shrink_to_fit();
+
+        child = node->child;
+        __atomic_store_n(&node->child, (NBT*)nullptr, __ATOMIC_RELEASE);
+        for(NBT* cur = child ; cur ; cur = cur->next)
+            forget_locked(frozen, cur);
+        auto it = frozen->entries.find(node);
+        if(it != frozen->entries.end())
+        {
+            /* Frozen again after a thaw */
+            drop_entry(frozen, it);
+        }
+        FrozenNode& entry = frozen->entries[node];
+        entry.type = (NBT_Tags)node->type;
+        entry.compression = compression;
+        entry.blob = std::move(blob);
+        entry.live_bytes = live;
+        entry.thawed = false;
+
+        frozen->stats.frozen++;
+        frozen->stats.freezes++;
+        frozen->stats.blob_bytes += entry.blob.size();
+        frozen->stats.saved_bytes += live - entry.blob.size();
+        publish_counts(frozen);
+    }
+
+    while(child)
+    {
+        NBT* next = child->next;
+        child->prev = nullptr;
+        child->next = nullptr;
+        dh_nbt_free(child);
+        child = next;
+    }
+    return true;
+}
+
+bool dh_nbt_freeze(DhNbtFreezeRoot* frozen, NBT* node, DhNbtCompression compression)
+{
+    if(!frozen || !node || !is_container(node) || !node->child)
+        return false;
+    if(compression == DH_COMPRESSION_AUTO)
+        compression = dh_nbt_compression_available(DH_COMPRESSION_ZSTD) ? DH_COMPRESSION_ZSTD
+                                                                         : DH_COMPRESSION_NONE;
+    else if(compression != DH_COMPRESSION_NONE && !dh_nbt_compression_available(compression))
+        return false;
+    return freeze_node(frozen, node, compression);
+}
+
+/* The children of a frozen entry, in a new node of its type */
+static NBT* decode_entry(FrozenNode& entry)
+{
+    const guint8* data = entry.blob.data();
+    gsize len = entry.blob.size();
+    std::vector<guint8> raw;
+    if(entry.compression != DH_COMPRESSION_NONE)
+    {
+        if(!dh_nbt_decompress(data, len, entry.compression, raw)) return nullptr;
+        data = raw.data();
+        len = raw.size();
+    }
+    const guint8* pos = data;
+    return dh_nbt_read_payload(entry.type, pos, data + len);
+}
+
+/* Splice the children back, published for the readers that load
+ * `child` without the lock */
+static bool thaw_locked(DhNbtFreezeRoot* frozen, EntryIter it)
+{
+    NBT* node = it->first;
+    FrozenNode& entry = it->second;
+    NBT* holder = decode_entry(entry);
+    if(!holder) return false;
+    __atomic_store_n(&node->child, holder->child, __ATOMIC_RELEASE);
+    holder->child = nullptr;
+    dh_nbt_free(holder);
+
+    DhNbtFreezeStats& stats = frozen->stats;
+    stats.frozen--;
+    stats.thaws++;
+    stats.blob_bytes -= entry.blob.size();
+    stats.saved_bytes -= entry.live_bytes - entry.blob.size();
+    if(!frozen->budget) frozen->entries.erase(it);
+    else
+    {
+        entry.thawed = true;
+        entry.blob = std::vector<guint8>();
+        frozen->lru.push_front(node);
+        entry.lru = frozen->lru.begin();
+        stats.thawed++;
+        stats.thawed_bytes += entry.live_bytes;
+    }
+    publish_counts(frozen);
+    return true;
+}
+
+bool dh_nbt_freeze_enter(DhNbtFreezeRoot* frozen, NBT* node, NBT*& child)
+{
+    child = dh_nbt_child(node);
+    if(!frozen || !is_container(node)) return true;
+    /* Nothing frozen, or nothing tracked for a resident node */
+    if(!(child ? frozen->thawed_now : frozen->frozen_now).load(std::memory_order_relaxed))
+        return true;
+    std::lock_guard<std::mutex> guard(frozen->lock);
+    /* Another thread may have thawed it meanwhile */
+    child = dh_nbt_child(node);
+    auto it = frozen->entries.find(node);
+    if(it == frozen->entries.end()) return true;
+    if(it->second.thawed)
+    {
+        frozen->lru.splice(frozen->lru.begin(), frozen->lru, it->second.lru);
+        return true;
+    }
+    if(!thaw_locked(frozen, it)) return false;
+    child = dh_nbt_child(node);
+    return true;
+}
+
+bool dh_nbt_thaw(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    if(!frozen || !node || !is_container(node)) return false;
+    std::lock_guard<std::mutex> guard(frozen->lock);
+    auto it = frozen->entries.find(node);
+    if(it == frozen->entries.end()) return false;
+    if(it->second.thawed)
+    {
+        frozen->lru.splice(frozen->lru.begin(), frozen->lru, it->second.lru);
+        return false;
+    }
+    return thaw_locked(frozen, it);
+}
+
+/* Thawed children hold no entries, their frozen descendants were
+ * packed into the blob */
+static gsize thaw_walk(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    if(!is_container(node)) return 0;
+    NBT* first = dh_nbt_child(node);
+    if(!first) return dh_nbt_thaw(frozen, node) ? 1 : 0;
+    gsize ret = 0;
+    for(NBT* child = first ; child ; child = child->next)
+        ret += thaw_walk(frozen, child);
+    return ret;
+}
+
+gsize dh_nbt_thaw_all(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    if(!frozen || !node || !frozen->frozen_now.load(std::memory_order_relaxed)) return 0;
+    if(node != frozen->root) return thaw_walk(frozen, node);
+    /* The whole tree, by its entries */
+    std::vector<NBT*> nodes;
+    {
+        std::lock_guard<std::mutex> guard(frozen->lock);
+        for(auto& item : frozen->entries)
+            if(!item.second.thawed) nodes.push_back(item.first);
+    }
+    gsize ret = 0;
+    for(NBT* item : nodes)
+        ret += dh_nbt_thaw(frozen, item);
+    return ret;
+}
+
+bool dh_nbt_is_frozen(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    if(!frozen || !node || !is_container(node) || dh_nbt_child(node)) return false;
+    std::lock_guard<std::mutex> guard(frozen->lock);
+    FrozenNode* entry = find_entry(frozen, node);
+    return entry && !entry->thawed;
+}
+
+bool dh_nbt_frozen_payload(DhNbtFreezeRoot* frozen, NBT* node, std::vector<guint8>& out)
+{
+    if(!frozen || dh_nbt_child(node)) return false;
+    std::lock_guard<std::mutex> guard(frozen->lock);
+    FrozenNode* entry = find_entry(frozen, node);
+    if(!entry || entry->thawed) return false;
+    if(entry->compression == DH_COMPRESSION_NONE)
+    {
+        out.insert(out.end(), entry->blob.begin(), entry->blob.end());
+        return true;
+    }
+    std::vector<guint8> raw;
+    if(!dh_nbt_decompress(entry->blob.data(), entry->blob.size(), entry->compression, raw))
+        return false;
+    out.insert(out.end(), raw.begin(), raw.end());
+    return true;
+}
+
+NBT* dh_nbt_frozen_copy(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    if(!frozen || !node || !is_container(node) || dh_nbt_child(node)) return nullptr;
+    std::lock_guard<std::mutex> guard(frozen->lock);
+    FrozenNode* entry = find_entry(frozen, node);
+    if(!entry || entry->thawed) return nullptr;
+    return decode_entry(*entry);
+}
+
+void dh_nbt_freeze_forget(DhNbtFreezeRoot* frozen, NBT* node)
+{
+    if(!frozen || !node) return;
+    std::lock_guard<std::mutex> guard(frozen->lock);
+    if(!frozen->entries.empty()) forget_locked(frozen, node);
+}
+
+void dh_nbt_freeze_set_budget(DhNbtFreezeRoot* frozen, gsize budget)
+{
+    if(!frozen) return;
+    std::lock_guard<std::mutex> guard(frozen->lock);
+    frozen->budget = budget;
+    if(budget) return;
+    /* Without a budget nothing thawed is tracked */
+    while(!frozen->lru.empty())
+        drop_entry(frozen, frozen->entries.find(frozen->lru.back()));
+}
+
+gsize dh_nbt_freeze_collect(DhNbtFreezeRoot* frozen)
+{
+    if(!frozen) return 0;
+    gsize ret = 0;
+    for(;;)
+    {
+        NBT* node = nullptr;
+        DhNbtCompression compression = DH_COMPRESSION_NONE;
+        {
+            std::lock_guard<std::mutex> guard(frozen->lock);
+            if(!frozen->budget || frozen->stats.thawed_bytes <= frozen->budget || frozen->lru.empty())
+                break;
+            node = frozen->lru.back();
+            compression = frozen->entries[node].compression;
+        }
+        if(node->child && freeze_node(frozen, node, compression))
+        {
+            ret++;
+            continue;
+        }
+        /* Emptied or no longer worth it, stop tracking it */
+        std::lock_guard<std::mutex> guard(frozen->lock);
+        auto it = frozen->entries.find(node);
+        if(it != frozen->entries.end()) drop_entry(frozen, it);
+    }
+    return ret;
+}
+
+DhNbtFreezeStats dh_nbt_freeze_stats(DhNbtFreezeRoot* frozen)
+{
+    if(!frozen)
+    {
+        DhNbtFreezeStats stats = {};
+        return stats;
+    }
+    std::lock_guard<std::mutex> guard(frozen->lock);
+    return frozen->stats;
+}
@@ -0,0 +1,109 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_FREEZE_HPP
+#define NBT_FREEZE_HPP
+
+#include <glib.h>
+#include "libnbt/nbt.h"
+#include "nbt_compress.hpp"
+
+/* Cold subtrees: freezing a compound or list serializes its children
+ * into a blob, compressed if asked, and frees them. The node stays in
+ * the tree without children until child() descends into it, or a
+ * walker given an instance reaches it, which thaws it back under the
+ * lock of the root; the children are published so that concurrent
+ * readers going through child() see them whole. Blobs are kept in a
+ * side table owned by the storage of their root, so only owned roots
+ * can freeze.
+ *
+ * With a budget set on a root, subtrees frozen once stay tracked after
+ * thawing, in the order child() last entered them, and collect freezes
+ * the least recent ones again until the thawed ones fit in the budget.
+ *
+ * Freezing and collecting edit the tree: like rm_node(), they free the
+ * children of the subtrees they pack, and every NBT* or cursor held
+ * inside those subtrees dangles. */
+typedef struct {
+    guint64 frozen;        /* Subtrees frozen now */
+    guint64 thawed;        /* Frozen before and resident now, with a budget */
+    guint64 blob_bytes;    /* Memory held by the blobs */
+    guint64 saved_bytes;   /* Estimated memory of the frozen children minus the blobs */
+    guint64 thawed_bytes;  /* Estimated memory of the thawed subtrees */
+    guint64 freezes;
+    guint64 thaws;
+} DhNbtFreezeStats;
+
+#ifdef __cplusplus
+#include <memory>
+#include <vector>
+#include "nbt_stats.hpp"
+
+/* The side table of one root, created on its first freeze */
+class DhNbtFreezeRoot;
+
+/* The deleter of owned roots; the table goes with the storage, after
+ * the tree, at a cost of its entries */
+struct DhNbtRootDeleter
+{
+  std::shared_ptr<DhNbtFreezeRoot> frozen;
+  void operator()(NBT* root) const { dh_nbt_free(root); }
+};
+
+std::shared_ptr<DhNbtFreezeRoot> dh_nbt_freeze_root_new(NBT* root);
+
+/* `child` of a node that a thaw may be publishing on another thread */
+inline NBT* dh_nbt_child(NBT* node)
+{
+    return __atomic_load_n(&node->child, __ATOMIC_ACQUIRE);
+}
+
+/* The functions below take the table of the root of `node`, and do
+ * nothing for a null one */
+
+/* DH_COMPRESSION_AUTO for zstd when available, else none. Fails on an
+ * empty node, or if the blob would not be smaller than the children. */
+bool dh_nbt_freeze(DhNbtFreezeRoot* frozen, NBT* node, DhNbtCompression compression);
+/* The children of `node` as child() reads them: thawed first if frozen,
+ * and marked as recently used if tracked. False if the blob could not
+ * be decoded. */
+bool dh_nbt_freeze_enter(DhNbtFreezeRoot* frozen, NBT* node, NBT*& child);
+/* Thaw `node` if it is frozen, true if it was. With a budget, a thawed
+ * subtree that is still tracked becomes the most recently used. */
+bool dh_nbt_thaw(DhNbtFreezeRoot* frozen, NBT* node);
+/* Thaw every frozen node of the subtree of `node`, returns how many */
+gsize dh_nbt_thaw_all(DhNbtFreezeRoot* frozen, NBT* node);
+bool dh_nbt_is_frozen(DhNbtFreezeRoot* frozen, NBT* node);
+
+/* Append the payload of a frozen list or compound, false if not frozen */
+bool dh_nbt_frozen_payload(DhNbtFreezeRoot* frozen, NBT* node, std::vector<guint8>& out);
+/* A new node without key holding a decoded copy of the children of a
+ * frozen `node`, nullptr if not frozen; the tree is left as is */
+NBT* dh_nbt_frozen_copy(DhNbtFreezeRoot* frozen, NBT* node);
+
+/* Drop the entries of the subtree of `node`, before freeing it */
+void dh_nbt_freeze_forget(DhNbtFreezeRoot* frozen, NBT* node);
+
+/* 0, the default, drops the subtrees once thawed */
+void dh_nbt_freeze_set_budget(DhNbtFreezeRoot* frozen, gsize budget);
+/* Freeze thawed subtrees again down to the budget, returns how many */
+gsize dh_nbt_freeze_collect(DhNbtFreezeRoot* frozen);
+DhNbtFreezeStats dh_nbt_freeze_stats(DhNbtFreezeRoot* frozen);
+
+#endif
+
+#endif /* NBT_FREEZE_HPP */
@@ -16,6 +16,8 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
 #include "nbt_interface.hpp"
+#include "nbt_stats.hpp"
+#include "nbt_codec.hpp"
 #include <stdexcept>
 #include <gio/gio.h>
 
@@ -56,6 +58,7 @@ static bool has_child(DhNbtInstance parent, DhNbtInstance child)
 
 static char *dh_strdup(const char *o_str)
 {
+    DH_NBT_STAT_ADD(DH_STAT_STRDUP_BYTES, strlen(o_str) + 1);
 #if (defined __STDC_VERSION__ && __STDC_VERSION__ > 201710L) || _POSIX_C_SOURCE >= 200809L
     return strdup(o_str); // use strdup if provided
 #else
@@ -73,53 +76,95 @@ static NBT* ret_non_filled_nbt()
 {
     NBT* new_nbt = (NBT*)malloc(sizeof(NBT));
     memset(new_nbt, 0, sizeof(NBT));
+    DH_NBT_STAT_ADD(DH_STAT_NODES_ALLOCATED, 1);
     return new_nbt;
 }
 
-DhNbtInstance::DhNbtInstance(const char* filename)
+#ifdef DH_NBT_STATS
+/* Size of what libnbt decompressed itself. zlib does not record it and
+ * the gzip trailer only has the last member, so the tree is measured. */
+static gsize decompressed_size(NBT* nbt, DhNbtCompression type, gsize len)
+{
+    if(type == DH_COMPRESSION_NONE) return len;
+    std::vector<guint8> raw;
+    if(nbt) dh_nbt_write_node(nbt, true, raw);
+    return raw.size();
+}
+#endif
+
+static NBT* parse_file(const char* filename)
 {
     gsize len = 0;
     guint8* content = nullptr;
     GError* err = nullptr;
+    NBT* nbt = nullptr;
+    DH_NBT_STAT_TIME_BEGIN(start);
 
-    if(g_file_get_contents(filename, (char**)&content, &len, &err))
+    /* The stat key is known before reading the file */
+    DhNbtSidecarKey key;
+    bool has_key = dh_nbt_sidecar_get_mode() == DH_SIDECAR_STAT
+                   && dh_nbt_sidecar_key(filename, nullptr, 0, key);
+    if(has_key) nbt = dh_nbt_sidecar_load(filename, key);
+
+    if(!nbt && g_file_get_contents(filename, (char**)&content, &len, &err))
     {
-        NBT* nbt = NBT_Parse(content, len);
-        g_free(content);
-        if(nbt)
+        DH_NBT_STAT_ADD(DH_STAT_BYTES_READ, len);
+        if(dh_nbt_sidecar_get_mode() == DH_SIDECAR_HASH)
         {
-            parse_nbt_real(*this, nbt);
+            has_key = dh_nbt_sidecar_key(filename, content, len, key);
+            if(has_key) nbt = dh_nbt_sidecar_load(filename, key);
         }
-        else original_nbt = nullptr;
     }
-    else
+    if(content && !nbt)
     {
-        g_error_free(err);
-        original_nbt = nullptr;
+        DhNbtCompression type = dh_nbt_detect_compression(content, len);
+        std::vector<guint8> raw;
+        if(type != DH_COMPRESSION_NONE && dh_nbt_compression_available(type)
+           && dh_nbt_decompress(content, len, type, raw))
+        {
+            DH_NBT_STAT_ADD(DH_STAT_BYTES_DECOMPRESSED, raw.size());
+            nbt = NBT_Parse(raw.data(), raw.size());
+        }
+        else
+        {
+            /* Uncompressed, or gzip/zlib left to libnbt */
+            nbt = NBT_Parse(content, len);
+            DH_NBT_STAT_ADD(DH_STAT_BYTES_DECOMPRESSED, decompressed_size(nbt, type, len));
+            if(nbt && has_key)
+            {
+                if(type == DH_COMPRESSION_NONE) raw.assign(content, content + len);
+                else dh_nbt_write_node(nbt, true, raw);
+            }
+        }
+        DH_NBT_STAT_ADD(DH_STAT_NODES_ALLOCATED, dh_nbt_count_nodes(nbt));
+        if(nbt && has_key) dh_nbt_sidecar_store(filename, key, std::move(raw));
     }
+    else if(err) g_error_free(err);
+    g_free(content);
+
+    DH_NBT_STAT_ADD(DH_STAT_LOAD_CALLS, 1);
+    DH_NBT_STAT_TIME_END(DH_STAT_LOAD_TIME_US, start);
+    return nbt;
 }
 
-DhNbtInstance::DhNbtInstance(const char* filename, bool temporary_root)
+DhNbtInstance::DhNbtInstance(const char* filename)
 {
-    gsize len = 0;
-    guint8* content = nullptr;
-    GError* err = nullptr;
-
-    if(g_file_get_contents(filename, (char**)&content, &len, &err))
+    NBT* nbt = parse_file(filename);
+    if(nbt)
     {
-        NBT* nbt = NBT_Parse(content, len);
-        g_free(content);
-        if(nbt)
-        {
-            parse_nbt(*this, nbt, temporary_root);
-        }
-        else original_nbt = nullptr;
+        parse_nbt_real(*this, nbt);
     }
-    else
+    else original_nbt = current_nbt = nullptr;
+}
+
+DhNbtInstance::DhNbtInstance(const char* filename, bool temporary_root)
+{
+    NBT* nbt = parse_file(filename);
+    if(nbt)
     {
-        g_error_free(err);
-        original_nbt = nullptr;
+        parse_nbt(*this, nbt, temporary_root);
     }
+    else original_nbt = current_nbt = nullptr;
 }
 
 DhNbtInstance::DhNbtInstance(NBT* nbt, bool tr)
@@ -287,6 +332,8 @@ bool DhNbtInstance::is_type(DhNbtType type)
 
 bool DhNbtInstance::parent()
 {
+    /* At the root, or a cursor made without its parents */
+    if(tree_struct.empty()) return false;
     int len = tree_struct.size();
     current_nbt = tree_struct[len - 1];
     tree_struct.resize(len - 1);
@@ -297,8 +344,12 @@ bool DhNbtInstance::child()
 {
     if(is_non_null() && (is_type(DH_TYPE_Compound) || is_type(DH_TYPE_List)))
     {
+        /* Frozen subtrees are thawed on the way in */
+        NBT* first = nullptr;
+        if(!dh_nbt_freeze_enter(get_freeze_root(), current_nbt, first)) return false;
         tree_struct.push_back(current_nbt);
-        current_nbt = current_nbt->child;
+        DH_NBT_STAT_ADD(DH_STAT_TREE_PUSHES, 1);
+        current_nbt = first;
         return true;
     }
     else return false;
@@ -310,6 +361,7 @@ bool DhNbtInstance::child(const char* key)
     {
         do
         {
+            DH_NBT_STAT_ADD(DH_STAT_KEY_COMPARISONS, 1);
             if(get_key() && !strcmp(get_key(), key))
                 return true;
         }
@@ -367,6 +419,7 @@ bool DhNbtInstance::prepend(DhNbtInstance child)
     {
         if(is_type(DH_TYPE_List) || is_type(DH_TYPE_Compound))
         {
+            dh_nbt_freeze_forget(get_freeze_root(), current_nbt);
             current_nbt->child = child.get_current_nbt();
             return true;
         }
@@ -377,6 +430,7 @@ bool DhNbtInstance::prepend(DhNbtInstance child)
 
 bool DhNbtInstance::insert_after(DhNbtInstance sibling, DhNbtInstance node)
 {
+    if(is_non_null()) dh_nbt_thaw(get_freeze_root(), current_nbt);
     if(has_child(*this, sibling))
     {
         if(sibling.is_non_null())
@@ -404,6 +458,7 @@ bool DhNbtInstance::insert_after(DhNbtInstance sibling, DhNbtInstance node)
 
 bool DhNbtInstance::insert_before(DhNbtInstance sibling, DhNbtInstance node)
 {
+    if(is_non_null()) dh_nbt_thaw(get_freeze_root(), current_nbt);
     if(has_child(*this, sibling))
     {
         if(sibling.is_non_null())
@@ -523,82 +578,230 @@ const gint64* DhNbtInstance::get_long_array(int& len)
 
 void DhNbtInstance::set_string(const char* str)
 {
+    if(!is_type(DH_TYPE_String)) throw std::domain_error("Not the right type!");
     free(current_nbt->value_a.value);
     current_nbt->value_a.value = dh_strdup(str);
     current_nbt->value_a.len = strlen(str) + 1;
 }
 
-bool DhNbtInstance::save_to_file(const char* pos)
+void DhNbtInstance::set_integer(gint64 val)
+{
+    switch(get_type())
+    {
+        case DH_TYPE_Byte:  current_nbt->value_i = (gint8)val; break;
+        case DH_TYPE_Short: current_nbt->value_i = (gint16)val; break;
+        case DH_TYPE_Int:   current_nbt->value_i = (gint32)val; break;
+        case DH_TYPE_Long:  current_nbt->value_i = val; break;
+        default: throw std::domain_error("Not the right type!");
+    }
+}
+
+void DhNbtInstance::set_float(float val)
+{
+    if(is_type(DH_TYPE_Float)) current_nbt->value_d = val;
+    else throw std::domain_error("Not the right type!");
+}
+
+void DhNbtInstance::set_double(double val)
+{
+    if(is_type(DH_TYPE_Double)) current_nbt->value_d = val;
+    else throw std::domain_error("Not the right type!");
+}
+
+static void set_array(NBT* nbt, const void* val, int len, int width)
+{
+    void* new_array = malloc(len * width + 1);
+    memcpy(new_array, val, len * width);
+    free(nbt->value_a.value);
+    nbt->value_a.value = new_array;
+    nbt->value_a.len = len;
+}
+
+void DhNbtInstance::set_byte_array(const gint8* val, int len)
+{
+    if(is_type(DH_TYPE_Byte_Array)) set_array(current_nbt, val, len, sizeof(gint8));
+    else throw std::domain_error("Not the right type!");
+}
+
+void DhNbtInstance::set_int_array(const gint32* val, int len)
+{
+    if(is_type(DH_TYPE_Int_Array)) set_array(current_nbt, val, len, sizeof(gint32));
+    else throw std::domain_error("Not the right type!");
+}
+
+void DhNbtInstance::set_long_array(const gint64* val, int len)
+{
+    if(is_type(DH_TYPE_Long_Array)) set_array(current_nbt, val, len, sizeof(gint64));
+    else throw std::domain_error("Not the right type!");
+}
+
+static bool write_file(const char* pos, const guint8* data, gsize len)
+{
+    GFile* file = g_file_new_for_path(pos);
+    if(!file) return false;
+    if(!g_file_query_exists(file, NULL))
+        g_file_create(file, G_FILE_CREATE_NONE, NULL, NULL);
+    GFileIOStream* fios = g_file_open_readwrite(file, NULL, NULL);
+    if(fios)
+    {
+        GOutputStream* os = g_io_stream_get_output_stream(G_IO_STREAM(fios));
+        gsize written = 0;
+        bool ret = g_output_stream_write_all(os, data, len, &written, NULL, NULL);
+        /* Drop the tail of a longer old file */
+        if(ret) ret = g_seekable_truncate(G_SEEKABLE(fios), len, NULL, NULL);
+        DH_NBT_STAT_ADD(DH_STAT_BYTES_WRITTEN, written);
+        g_object_unref(fios);
+        g_object_unref(file);
+        return ret;
+    }
+    else
+    {
+        g_object_unref(file);
+        return false;
+    }
+}
+
+/* Compress with libnbt itself */
+static bool pack_with_libnbt(NBT* root, NBT_Compression compression, std::vector<guint8>& out)
 {
-    NBT* root = get_original_nbt();
     int bit = 1;
     size_t len = 0;
 #ifndef LIBNBT_USE_LIBDEFLATE
     size_t old_len = 0;
 #endif
-    uint8_t* data = NULL;
-    while(1)
+    while(bit < 63)
     {
-        len = 1 << bit;
-        data = (uint8_t*)g_new0(uint8_t, len);
+        len = (size_t)1 << bit;
+        out.assign(len, 0);
         NBT_Error err;
-        int ret = NBT_Pack_Opt(root, data, &len, NBT_Compression_GZIP, &err);
+        int ret = NBT_Pack_Opt(root, out.data(), &len, compression, &err);
         if(ret == 0)
         {
 #ifndef LIBNBT_USE_LIBDEFLATE
             if(old_len != len) // compress not finish due to a bug in old libnbt (in submodule)
             {
                 old_len = len;
-                g_free(data);
                 bit++;
+                DH_NBT_STAT_ADD(DH_STAT_PACK_RETRIES, 1);
                 continue;
             }
 #endif
-            if(pos)
-            {
-                GFile* file = g_file_new_for_path(pos);
-                if(!file)
-                {
-                    g_free(data);
-                    return false;
-                }
-                if(!g_file_query_exists(file, NULL))
-                    g_file_create(file, G_FILE_CREATE_NONE, NULL, NULL);
-                GFileIOStream* fios = g_file_open_readwrite(file, NULL, NULL);
-                if(fios)
-                {
-                    GOutputStream* os = g_io_stream_get_output_stream(G_IO_STREAM(fios));
-                    int ret_d = g_output_stream_write(os, data, len, NULL, NULL);
-                    bool ret = (ret_d == -1 ? false : true);
-                    g_object_unref(fios);
-                    g_free(data);
-                    g_object_unref(file);
-                    return ret;
-                }
-                else
-                {
-                    g_object_unref(file);
-                    g_free(data);
-                    return false;
-                }
-            }
-            else
-            {
-                return false;
-            }
-        }
-        else if(bit < 63)
-        {
-            g_free(data);
-            bit++; // It might be not enough space
+            out.resize(len);
+            return true;
         }
-        else
+        bit++; // It might be not enough space
+        DH_NBT_STAT_ADD(DH_STAT_PACK_RETRIES, 1);
+    }
+    out.clear();
+    return false;
+}
+
+bool DhNbtInstance::pack(std::vector<guint8>& out, DhNbtCompression compression)
+{
+    NBT* root = get_original_nbt();
+    if(!root) return false;
+    if(compression == DH_COMPRESSION_AUTO)
+        compression = DH_COMPRESSION_GZIP;
+
+    if(dh_nbt_compression_available(compression))
+    {
+        /* Pack raw in one pass, then compress with the backend */
+        if(compression == DH_COMPRESSION_NONE)
         {
-            g_free(data);
-            return false;
+            out.clear();
+            dh_nbt_write_node(root, true, out, get_freeze_root());
+            return true;
         }
+        std::vector<guint8> raw;
+        dh_nbt_write_node(root, true, raw, get_freeze_root());
+        return dh_nbt_compress(raw.data(), raw.size(), compression, out);
     }
-    return false;
+    /* libnbt does not know about frozen subtrees, give it a resident copy */
+    NBT* copy = nullptr;
+    if(get_freeze_stats().frozen)
+    {
+        std::vector<guint8> raw;
+        dh_nbt_write_node(root, true, raw, get_freeze_root());
+        const guint8* pos = raw.data();
+        copy = dh_nbt_read_node(true, pos, pos + raw.size());
+        if(!copy) return false;
+        root = copy;
+    }
+    bool ret = false;
+    if(compression == DH_COMPRESSION_GZIP)
+        ret = pack_with_libnbt(root, NBT_Compression_GZIP, out);
+    else if(compression == DH_COMPRESSION_ZLIB)
+        ret = pack_with_libnbt(root, NBT_Compression_ZLIB, out);
+    if(copy) dh_nbt_free(copy);
+    return ret;
+}
+
+bool DhNbtInstance::save_to_file(const char* pos)
+{
+    return save_to_file(pos, DH_COMPRESSION_GZIP);
+}
+
+bool DhNbtInstance::save_to_file(const char* pos, DhNbtCompression compression)
+{
+    if(!pos) return false;
+    DH_NBT_STAT_TIME_BEGIN(start);
+    std::vector<guint8> data;
+    bool ret = pack(data, compression) && write_file(pos, data.data(), data.size());
+    DH_NBT_STAT_ADD(DH_STAT_SAVE_CALLS, 1);
+    DH_NBT_STAT_TIME_END(DH_STAT_SAVE_TIME_US, start);
+    return ret;
+}
+
+bool DhNbtInstance::save_to_file_atomic(const char* pos, DhNbtCompression compression,
+                                        DhNbtFsyncPolicy policy)
+{
+    DhNbtSaveBatch batch(policy);
+    return batch.add(*this, pos, compression) && batch.commit();
+}
+
+DhNbtFreezeRoot* DhNbtInstance::get_freeze_root(bool create)
+{
+    /* Temporary roots have no table */
+    auto deleter = std::get_deleter<DhNbtRootDeleter>(original_nbt_storage);
+    if(!deleter) return nullptr;
+    if(!deleter->frozen && create)
+        deleter->frozen = dh_nbt_freeze_root_new(get_original_nbt());
+    return deleter->frozen.get();
+}
+
+bool DhNbtInstance::freeze(DhNbtCompression compression)
+{
+    return is_non_null() && dh_nbt_freeze(get_freeze_root(true), current_nbt, compression);
+}
+
+bool DhNbtInstance::thaw()
+{
+    return is_non_null() && dh_nbt_thaw(get_freeze_root(), current_nbt);
+}
+
+gsize DhNbtInstance::thaw_all()
+{
+    return is_non_null() ? dh_nbt_thaw_all(get_freeze_root(), current_nbt) : 0;
+}
+
+bool DhNbtInstance::is_frozen()
+{
+    return is_non_null() && dh_nbt_is_frozen(get_freeze_root(), current_nbt);
+}
+
+void DhNbtInstance::set_freeze_budget(gsize budget)
+{
+    dh_nbt_freeze_set_budget(get_freeze_root(true), budget);
+}
+
+gsize DhNbtInstance::collect_frozen()
+{
+    return dh_nbt_freeze_collect(get_freeze_root());
+}
+
+DhNbtFreezeStats DhNbtInstance::get_freeze_stats()
+{
+    return dh_nbt_freeze_stats(get_freeze_root());
 }
 
 DhNbtInstance DhNbtInstance::dup_current_as_original(bool temp_root)
@@ -639,6 +842,14 @@ DhNbtInstance DhNbtInstance::dup_current_as_original(bool temp_root)
     {
         /* The outer struct */
         DhNbtInstance ret(get_type(), get_key(), temp_root);
+        NBT* frozen = dh_nbt_frozen_copy(get_freeze_root(), current_nbt);
+        if(frozen)
+        {
+            ret.current_nbt->child = frozen->child;
+            frozen->child = nullptr;
+            dh_nbt_free(frozen);
+            return ret;
+        }
         DhNbtInstance origin_child(*this);
         DhNbtInstance head;
         DhNbtInstance prev;
@@ -669,7 +880,8 @@ static bool rm_node_internal(DhNbtInstance& child, NBT* root)
 
         child.get_current_nbt()->prev = nullptr;
         child.get_current_nbt()->next = nullptr;
-        NBT_Free(child.get_current_nbt());
+        dh_nbt_freeze_forget(child.get_freeze_root(), child.get_current_nbt());
+        dh_nbt_free(child.get_current_nbt());
 
         if(prev) prev->next = next;
         if(next) next->prev = prev;
@@ -728,17 +940,3 @@ void DhNbtInstance::self_free()
         rm_node_internal(item, root);
     }
 }
-
-extern "C"
-{
-    void* dh_nbt_instance_cpp_new()
-    {
-        return new DhNbtInstance();
-    }
-
-    void  dh_nbt_instance_cpp_free(void* mem)
-    {
-        DhNbtInstance* instance = dynamic_cast<DhNbtInstance*>((DhNbtInstance*)mem);
-        delete instance;
-    }
-}
\ No newline at end of file
@@ -18,7 +18,6 @@
 #ifndef NBT_INTERFACE_HPP
 #define NBT_INTERFACE_HPP
 
-#ifdef __cplusplus
 /* The enum type for recognize */
 #ifndef DH_NBT_TYPES
 #define DH_NBT_TYPES
@@ -28,6 +27,26 @@ typedef enum {
 #endif
 
 #include <glib.h>
+#include "nbt_stats.hpp"
+#include "nbt_compress.hpp"
+#include "nbt_save.hpp"
+#include "nbt_sidecar.hpp"
+#include "nbt_freeze.hpp"
+
+/* One node of dh_nbt_instance_cpp_flatten(), in pre-order */
+typedef struct {
+    gint32 type;    /* DhNbtType */
+    gint32 parent;  /* Index of the parent node, -1 for the first one */
+    gint32 key;     /* Offset of the key in the pool, -1 if none */
+    gint32 len;     /* Children, array elements or string bytes */
+    union {
+        gint64 i;
+        double d;
+        gint64 offset;  /* Of string and array data in the pool */
+    } value;
+} DhNbtFlatNode;
+
+#ifdef __cplusplus
 #include <vector>
 #include <memory>
 
@@ -74,7 +93,7 @@ public:
   void set_original_nbt(NBT* nbt) 
   { 
     original_nbt = nbt;
-    original_nbt_storage.reset(nbt, NBT_Free); 
+    original_nbt_storage.reset(nbt, DhNbtRootDeleter()); 
   }
   void set_temp_original_nbt(NBT* nbt)
   {
@@ -90,6 +109,7 @@ public:
   bool next();
   bool parent();
   int child_value();
+  /* Thaws a frozen subtree, false if its blob can not be decoded */
   bool child();
   bool child(const char* key);
   bool child(int index);
@@ -118,13 +138,41 @@ public:
   const gint32 *get_int_array(int& len);
   const gint64 *get_long_array(int& len);
 
+  /* The setters keep the type and throw like the getters */
   void set_string(const char* str);
+  void set_integer(gint64 val);
+  void set_float(float val);
+  void set_double(double val);
+  void set_byte_array(const gint8* val, int len);
+  void set_int_array(const gint32* val, int len);
+  void set_long_array(const gint64* val, int len);
 
   bool prepend(DhNbtInstance child);
   bool insert_after(DhNbtInstance sibling, DhNbtInstance node);
   bool insert_before(DhNbtInstance sibling, DhNbtInstance node);
 
+  /* Serialize the whole tree into `out` */
+  bool pack(std::vector<guint8>& out, DhNbtCompression compression);
+  /* Gzip, as expected by Minecraft */
   bool save_to_file(const char *pos);
+  bool save_to_file(const char *pos, DhNbtCompression compression);
+  /* Write to a temporary file next to `pos` and rename it into place,
+   * see DhNbtSaveBatch to share the sync between many files */
+  bool save_to_file_atomic(const char *pos, DhNbtCompression compression, DhNbtFsyncPolicy policy);
+
+  /* Cold subtrees, see nbt_freeze.hpp. freeze(), thaw() and
+   * thaw_all() work on the current node, the others on the whole
+   * tree. Freezing fails on a temporary root. child() thaws on its
+   * own, thaw() is for readers going to the nodes directly. */
+  bool freeze(DhNbtCompression compression);
+  bool thaw();
+  gsize thaw_all();
+  bool is_frozen();
+  void set_freeze_budget(gsize budget);
+  gsize collect_frozen();
+  DhNbtFreezeStats get_freeze_stats();
+  /* The side table of the root, nullptr if nothing was frozen */
+  DhNbtFreezeRoot* get_freeze_root(bool create = false);
 
 private:
     /* Root NBT storage */
@@ -140,8 +188,94 @@ private:
 extern "C"
 {
 #endif
+  /* The instances are `DhNbtInstance*`. Functions returning gboolean
+   * fail on a wrong type or position, nothing throws across the ABI.
+   * Buffers returned by the library are freed with g_free(). */
   void* dh_nbt_instance_cpp_new();
+  void* dh_nbt_instance_cpp_new_from_file(const char* filename);
+  /* Empty node to be filled with the setters; use a temporary root
+   * for a node that will be inserted into another tree */
+  void* dh_nbt_instance_cpp_new_type(DhNbtType type, const char* key, gboolean temporary_root);
+  /* Another cursor on the same tree */
+  void* dh_nbt_instance_cpp_dup(void* instance);
+  /* Deep copy of the current node as a new root */
+  void* dh_nbt_instance_cpp_dup_current(void* instance);
   void  dh_nbt_instance_cpp_free(void* mem);
+
+  /* Navigation */
+  gboolean dh_nbt_instance_cpp_child(void* instance);
+  gboolean dh_nbt_instance_cpp_child_key(void* instance, const char* key);
+  gboolean dh_nbt_instance_cpp_child_index(void* instance, int index);
+  gboolean dh_nbt_instance_cpp_next(void* instance);
+  gboolean dh_nbt_instance_cpp_prev(void* instance);
+  gboolean dh_nbt_instance_cpp_parent(void* instance);
+  void     dh_nbt_instance_cpp_goto_root(void* instance);
+  gboolean dh_nbt_instance_cpp_is_non_null(void* instance);
+  DhNbtType dh_nbt_instance_cpp_get_type(void* instance);
+  int      dh_nbt_instance_cpp_child_value(void* instance);
+  const char* dh_nbt_instance_cpp_get_key(void* instance);
+  void     dh_nbt_instance_cpp_set_key(void* instance, const char* key);
+
+  /* Typed access, any integer type for the integer functions. The array
+   * getters return NULL without a `len` to store the length in. */
+  gboolean dh_nbt_instance_cpp_get_integer(void* instance, gint64* val);
+  gboolean dh_nbt_instance_cpp_get_double(void* instance, double* val);
+  const char* dh_nbt_instance_cpp_get_string(void* instance);
+  const gint8*  dh_nbt_instance_cpp_get_byte_array(void* instance, int* len);
+  const gint32* dh_nbt_instance_cpp_get_int_array(void* instance, int* len);
+  const gint64* dh_nbt_instance_cpp_get_long_array(void* instance, int* len);
+  gboolean dh_nbt_instance_cpp_set_integer(void* instance, gint64 val);
+  gboolean dh_nbt_instance_cpp_set_double(void* instance, double val);
+  gboolean dh_nbt_instance_cpp_set_string(void* instance, const char* val);
+  gboolean dh_nbt_instance_cpp_set_byte_array(void* instance, const gint8* val, int len);
+  gboolean dh_nbt_instance_cpp_set_int_array(void* instance, const gint32* val, int len);
+  gboolean dh_nbt_instance_cpp_set_long_array(void* instance, const gint64* val, int len);
+
+  /* Editing, `sibling` may be NULL (insert_before then appends) */
+  gboolean dh_nbt_instance_cpp_insert_before(void* instance, void* sibling, void* node);
+  gboolean dh_nbt_instance_cpp_insert_after(void* instance, void* sibling, void* node);
+  gboolean dh_nbt_instance_cpp_rm_node_key(void* instance, const char* key);
+  gboolean dh_nbt_instance_cpp_rm_node_index(void* instance, int index);
+
+  /* Batch access, one call for many nodes */
+  /* Find `n` children of the current compound in one pass; `out[i]`
+   * is a new instance or NULL. Returns the number found, or -1 on a
+   * NULL array or key (also for the two below). */
+  int dh_nbt_instance_cpp_get_children(void* instance, const char* const* keys, int n, void** out);
+  /* Values of `n` integer/floating children; found[i] tells if out[i] is set */
+  int dh_nbt_instance_cpp_get_integers(void* instance, const char* const* keys, int n,
+                                       gint64* out, gboolean* found);
+  int dh_nbt_instance_cpp_get_doubles(void* instance, const char* const* keys, int n,
+                                      double* out, gboolean* found);
+  /* Elements of a list of integers/floating numbers (or an array);
+   * copies at most `capacity`, returns the total or -1 on wrong type,
+   * on a negative `capacity` or on a NULL `out` with a positive one */
+  int dh_nbt_instance_cpp_list_get_integers(void* instance, gint64* out, int capacity);
+  int dh_nbt_instance_cpp_list_get_doubles(void* instance, double* out, int capacity);
+  /* The whole subtree of the current node as a node table and a pool,
+   * every out argument is required */
+  gboolean dh_nbt_instance_cpp_flatten(void* instance, DhNbtFlatNode** nodes, gsize* n_nodes,
+                                       guint8** pool, gsize* pool_len);
+  /* The current node as raw NBT (type, key, payload) */
+  guint8* dh_nbt_instance_cpp_dump(void* instance, gsize* len);
+
+  /* Saving */
+  guint8*  dh_nbt_instance_cpp_pack(void* instance, DhNbtCompression compression, gsize* len);
+  gboolean dh_nbt_instance_cpp_save_to_file(void* instance, const char* pos, DhNbtCompression compression);
+  gboolean dh_nbt_instance_cpp_save_to_file_atomic(void* instance, const char* pos,
+                                                   DhNbtCompression compression, DhNbtFsyncPolicy policy);
+
+  /* Cold subtrees. Navigation and the getters thaw frozen nodes as they
+   * reach them. Freezing and collecting free the nodes inside the packed
+   * subtrees: instances positioned there, and those from get_children(),
+   * must not be used afterwards. */
+  gboolean dh_nbt_instance_cpp_freeze(void* instance, DhNbtCompression compression);
+  gboolean dh_nbt_instance_cpp_thaw(void* instance);
+  gsize    dh_nbt_instance_cpp_thaw_all(void* instance);
+  gboolean dh_nbt_instance_cpp_is_frozen(void* instance);
+  void     dh_nbt_instance_cpp_set_freeze_budget(void* instance, gsize budget);
+  gsize    dh_nbt_instance_cpp_collect_frozen(void* instance);
+  gboolean dh_nbt_instance_cpp_get_freeze_stats(void* instance, DhNbtFreezeStats* stats);
 #ifdef __cplusplus
 }
 #endif
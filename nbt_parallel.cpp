@@ -0,0 +1,142 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+
+#include "nbt_parallel.hpp"
+#include <condition_variable>
+#include <thread>
+
+/* Workers kept for the whole process, parked while there is no job.
+ * Only one job runs on it at a time. */
+struct DhNbtThreadPool
+{
+    std::mutex call_lock;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::vector<std::thread> threads;
+    const std::function<void(int)>* job = nullptr;
+    /* Next worker index to hand out, and the end of them */
+    int next = 0;
+    int wanted = 0;
+    int running = 0;
+    bool stopping = false;
+    /* First exception of the job */
+    std::exception_ptr error;
+
+    ~DhNbtThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& thread : threads)
+            thread.join();
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while(true)
+        {
+            wake.wait(guard, [this]() { return stopping || (job && next < wanted); });
+            if(stopping) return;
+            int worker = next++;
+            const std::function<void(int)>* func = job;
+            guard.unlock();
+            std::exception_ptr thrown;
+            try
+            {
+                (*func)(worker);
+            }
+            catch(...)
+            {
+                thrown = std::current_exception();
+            }
+            guard.lock();
+            if(thrown && !error) error = thrown;
+            if(--running == 0) done.notify_one();
+        }
+    }
+};
+
+/* Run `func(worker)`, keeping the first exception in `error` */
+static void run_caught(const std::function<void(int)>& func, int worker,
+                       std::mutex& lock, std::exception_ptr& error)
+{
+    try
+    {
+        func(worker);
+    }
+    catch(...)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(!error) error = std::current_exception();
+    }
+}
+
+static void run_spawned(int threads, const std::function<void(int)>& func)
+{
+    std::vector<std::thread> pool;
+    std::mutex lock;
+    std::exception_ptr error;
+    for(int i = 1 ; i < threads ; i++)
+        pool.emplace_back([&, i]() { run_caught(func, i, lock, error); });
+    run_caught(func, 0, lock, error);
+    for(auto& thread : pool)
+        thread.join();
+    if(error) std::rethrow_exception(error);
+}
+
+void dh_nbt_parallel_run(int threads, const std::function<void(int)>& func)
+{
+    if(threads <= 1)
+    {
+        func(0);
+        return;
+    }
+    static DhNbtThreadPool pool;
+    std::unique_lock<std::mutex> call(pool.call_lock, std::try_to_lock);
+    /* Busy with another call, or a nested one */
+    if(!call.owns_lock())
+    {
+        run_spawned(threads, func);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        while((int)pool.threads.size() < threads - 1)
+            pool.threads.emplace_back([]() { pool.work(); });
+        pool.job = &func;
+        pool.next = 1;
+        pool.wanted = threads;
+        pool.running = threads - 1;
+    }
+    pool.wake.notify_all();
+    std::exception_ptr error;
+    std::mutex lock;
+    run_caught(func, 0, lock, error);
+    std::unique_lock<std::mutex> guard(pool.lock);
+    pool.done.wait(guard, []() { return pool.running == 0; });
+    pool.job = nullptr;
+    if(!error) error = pool.error;
+    pool.error = nullptr;
+    guard.unlock();
+    call.unlock();
+    if(error) std::rethrow_exception(error);
+}
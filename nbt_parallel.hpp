@@ -0,0 +1,236 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_PARALLEL_HPP
+#define NBT_PARALLEL_HPP
+
+#include "nbt_interface.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/* Parallel read-only traversal of the subtree at the current node:
+ *
+ *   gint64 count = dh_nbt_map_reduce(instance, (gint64)0,
+ *       [](NBT* node, gint64& acc) { acc++; },
+ *       [](gint64& total, gint64& acc) { total += acc; });
+ *
+ * `map(node, acc)` runs once per node, on several threads at once,
+ * with the accumulator of the running thread, a copy of `init`. The
+ * accumulators are then folded into another copy of `init` with
+ * `reduce(total, acc)` on the calling thread. Children of compounds
+ * and lists are cut into runs of siblings which idle threads steal
+ * from the busy ones, and threads with nothing to steal sleep.
+ *
+ * The instance keeps the tree alive during the call; the tree must not
+ * be edited meanwhile, and `map` must not edit it either. Frozen
+ * subtrees are thawed when reached, as child() does. If `map` throws,
+ * the remaining nodes are skipped and the first exception is rethrown
+ * on the calling thread. */
+
+/* Siblings per stealable run */
+#define DH_NBT_PARALLEL_RUN 16
+
+/* `func(worker)` for each worker in [0, threads), 0 on the calling
+ * thread and the others on a pool kept for the process. Returns once
+ * all of them are done, rethrowing the first exception `func` threw. */
+void dh_nbt_parallel_run(int threads, const std::function<void(int)>& func);
+
+template<typename Acc, typename Map>
+class DhNbtParallelVisit
+{
+public:
+    DhNbtParallelVisit(int threads, const Acc& init, Map& map, DhNbtFreezeRoot* frozen)
+        : queues(threads), slots(threads), map(map), frozen(frozen)
+    {
+        for(auto& slot : slots)
+            slot.acc = init;
+        pending = 0;
+        queued = 0;
+        sleeping = 0;
+        stopped = false;
+    }
+
+    void run(NBT* root)
+    {
+        push(0, { root, 1 });
+        dh_nbt_parallel_run(queues.size(), [this](int worker) { work(worker); });
+        if(error) std::rethrow_exception(error);
+    }
+
+    template<typename Reduce>
+    void reduce(Acc& total, Reduce& func)
+    {
+        for(auto& slot : slots)
+            func(total, slot.acc);
+    }
+
+private:
+    struct Run
+    {
+        NBT* first;
+        int count;
+    };
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Run> runs;
+    };
+    /* One cache line each, the threads write them all the time */
+    struct alignas(64) Slot
+    {
+        Acc acc;
+    };
+
+    void push(int worker, Run run)
+    {
+        pending++;
+        {
+            std::lock_guard<std::mutex> guard(queues[worker].lock);
+            queues[worker].runs.push_back(run);
+        }
+        queued++;
+        /* A sleeper counted itself before checking queued, so either
+         * it sees this run or we see it */
+        if(sleeping.load() > 0) wake(false);
+    }
+
+    void wake(bool all)
+    {
+        {
+            std::lock_guard<std::mutex> guard(idle_lock);
+        }
+        if(all) idle.notify_all();
+        else idle.notify_one();
+    }
+
+    /* Newest from our own queue, oldest (the largest) from the others */
+    bool pop(int worker, Run& run)
+    {
+        for(size_t i = 0 ; i < queues.size() ; i++)
+        {
+            Queue& queue = queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if(queue.runs.empty()) continue;
+            if(i == 0)
+            {
+                run = queue.runs.back();
+                queue.runs.pop_back();
+            }
+            else
+            {
+                run = queue.runs.front();
+                queue.runs.pop_front();
+            }
+            queued--;
+            return true;
+        }
+        return false;
+    }
+
+    void work(int worker)
+    {
+        Run run;
+        while(pending.load() > 0)
+        {
+            if(!pop(worker, run))
+            {
+                std::unique_lock<std::mutex> guard(idle_lock);
+                sleeping++;
+                idle.wait(guard, [this]() { return pending.load() == 0 || queued.load() > 0; });
+                sleeping--;
+                continue;
+            }
+            /* After a failure the runs left are only drained */
+            NBT* node = run.first;
+            for(int i = 0 ; i < run.count && !stopped.load() ; i++, node = node->next)
+            {
+                try
+                {
+                    visit(worker, node);
+                }
+                catch(...)
+                {
+                    fail(std::current_exception());
+                }
+            }
+            if(--pending == 0) wake(true);
+        }
+    }
+
+    /* Children are queued, never walked here, so deep nesting does
+     * not grow the stack; our own queue is taken newest first */
+    void visit(int worker, NBT* node)
+    {
+        map(node, slots[worker].acc);
+        if(node->type != TAG_List && node->type != TAG_Compound) return;
+        NBT* child = nullptr;
+        if(!dh_nbt_freeze_enter(frozen, node, child)) return;
+        while(child)
+        {
+            NBT* first = child;
+            int count = 0;
+            for( ; child && count < DH_NBT_PARALLEL_RUN ; child = child->next)
+                count++;
+            push(worker, { first, count });
+        }
+    }
+
+    void fail(std::exception_ptr thrown)
+    {
+        std::lock_guard<std::mutex> guard(error_lock);
+        if(!error) error = thrown;
+        stopped = true;
+    }
+
+    std::vector<Queue> queues;
+    std::vector<Slot> slots;
+    /* Runs not finished, and of those the ones still in a queue */
+    std::atomic<gint64> pending;
+    std::atomic<gint64> queued;
+    std::atomic<int> sleeping;
+    std::atomic<bool> stopped;
+    std::mutex error_lock;
+    std::exception_ptr error;
+    std::mutex idle_lock;
+    std::condition_variable idle;
+    Map& map;
+    DhNbtFreezeRoot* frozen;
+};
+
+/* `threads` 0 for one per processor */
+template<typename Acc, typename Map, typename Reduce>
+Acc dh_nbt_map_reduce(DhNbtInstance& instance, const Acc& init, Map map, Reduce reduce, int threads = 0)
+{
+    Acc total = init;
+    /* Holds a reference on the tree for the whole call */
+    DhNbtInstance keep(instance);
+    NBT* root = keep.get_current_nbt();
+    if(!root) return total;
+    if(threads <= 0) threads = g_get_num_processors();
+
+    DhNbtParallelVisit<Acc, Map> visit(threads, init, map, keep.get_freeze_root());
+    visit.run(root);
+    visit.reduce(total, reduce);
+    return total;
+}
+
+#endif /* NBT_PARALLEL_HPP */
@@ -0,0 +1,243 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_interface.hpp"
+#include "nbt_save.hpp"
+#include <cerrno>
+#include <set>
+
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Bytes per write() call */
+static const gsize write_chunk = 1 << 20;
+#endif
+
+DhNbtSaveBatch::DhNbtSaveBatch(DhNbtFsyncPolicy policy)
+{
+    this->policy = policy;
+    failed = false;
+}
+
+DhNbtSaveBatch::~DhNbtSaveBatch()
+{
+    discard();
+}
+
+bool DhNbtSaveBatch::add(DhNbtInstance& instance, const char* pos, DhNbtCompression compression)
+{
+    std::vector<guint8> data;
+    DH_NBT_STAT_TIME_BEGIN(start);
+    bool ret = instance.pack(data, compression) && add_data(pos, data.data(), data.size());
+    DH_NBT_STAT_ADD(DH_STAT_SAVE_CALLS, 1);
+    DH_NBT_STAT_TIME_END(DH_STAT_SAVE_TIME_US, start);
+    if(!ret) failed = true;
+    return ret;
+}
+
+#ifdef G_OS_UNIX
+
+static bool write_all(int fd, const guint8* data, gsize len)
+{
+    gsize written = 0;
+    while(written < len)
+    {
+        gsize chunk = MIN(write_chunk, len - written);
+        ssize_t ret = write(fd, data + written, chunk);
+        if(ret < 0)
+        {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        written += ret;
+    }
+    DH_NBT_STAT_ADD(DH_STAT_BYTES_WRITTEN, written);
+    return true;
+}
+
+bool DhNbtSaveBatch::add_data(const char* pos, const guint8* data, gsize len)
+{
+    if(!pos)
+    {
+        failed = true;
+        return false;
+    }
+    gchar* dir = g_path_get_dirname(pos);
+    gchar* base = g_path_get_basename(pos);
+    gchar* temp = g_strdup_printf("%s/.%s.XXXXXX", dir, base);
+    g_free(dir);
+    g_free(base);
+
+    /* Created with 0666 less the umask, as open() would */
+    int fd = g_mkstemp_full(temp, O_RDWR, 0666);
+    if(fd < 0)
+    {
+        g_free(temp);
+        failed = true;
+        return false;
+    }
+
+    /* Keep the mode of the file we replace */
+    struct stat st;
+    if(stat(pos, &st) == 0) fchmod(fd, st.st_mode & 07777);
+
+    bool ret = true;
+#ifdef __linux__
+    /* Only running out of space is fatal, not missing support */
+    if(len && posix_fallocate(fd, 0, len) == ENOSPC)
+        ret = false;
+#endif
+    if(ret) ret = write_all(fd, data, len);
+#ifdef __linux__
+    /* Start the writeback now, so the sync in commit() finds less to do */
+    if(ret && policy != DH_FSYNC_NONE)
+        sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+    /* Reopened in commit(), so a large batch does not hold a fd per file */
+    if(close(fd) != 0) ret = false;
+
+    if(ret) pending.push_back({ temp, pos });
+    else
+    {
+        unlink(temp);
+        failed = true;
+    }
+    g_free(temp);
+    return ret;
+}
+
+#ifdef __linux__
+/* One syncfs() per filesystem holding a file of the batch, instead of
+ * one sync per file. Writeback errors are reported since Linux 5.8. */
+static bool sync_files(const std::vector<std::string>& paths)
+{
+    std::set<dev_t> devices;
+    for(auto& path : paths)
+    {
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0) return false;
+        if(!devices.insert(st.st_dev).second) continue;
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        bool ret = (syncfs(fd) == 0);
+        if(close(fd) != 0) ret = false;
+        if(!ret) return false;
+    }
+    return true;
+}
+#else
+static bool sync_files(const std::vector<std::string>& paths)
+{
+    for(auto& path : paths)
+    {
+        int fd = open(path.c_str(), O_WRONLY);
+        if(fd < 0) return false;
+        bool ret = (fsync(fd) == 0);
+        if(close(fd) != 0) ret = false;
+        if(!ret) return false;
+    }
+    return true;
+}
+#endif
+
+static bool sync_dir(const std::string& dir)
+{
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0) return false;
+    bool ret = (fsync(fd) == 0);
+    close(fd);
+    return ret;
+}
+
+bool DhNbtSaveBatch::commit()
+{
+    if(failed)
+    {
+        discard();
+        return false;
+    }
+
+    if(policy != DH_FSYNC_NONE)
+    {
+        std::vector<std::string> temps;
+        for(auto& item : pending)
+            temps.push_back(item.temp);
+        if(!sync_files(temps))
+        {
+            discard();
+            return false;
+        }
+    }
+
+    bool ret = true;
+    std::set<std::string> dirs;
+    for(auto& item : pending)
+    {
+        if(rename(item.temp.c_str(), item.target.c_str()) != 0)
+        {
+            unlink(item.temp.c_str());
+            ret = false;
+        }
+        else if(policy == DH_FSYNC_FULL)
+        {
+            gchar* dir = g_path_get_dirname(item.target.c_str());
+            dirs.insert(dir);
+            g_free(dir);
+        }
+    }
+    pending.clear();
+
+    for(auto& dir : dirs)
+        if(!sync_dir(dir)) ret = false;
+    return ret;
+}
+
+void DhNbtSaveBatch::discard()
+{
+    for(auto& item : pending)
+        unlink(item.temp.c_str());
+    pending.clear();
+    failed = false;
+}
+
+#else
+
+/* g_file_set_contents() already writes a temporary file and renames
+ * it, so there is nothing left to batch here */
+bool DhNbtSaveBatch::add_data(const char* pos, const guint8* data, gsize len)
+{
+    bool ret = pos && g_file_set_contents(pos, (const gchar*)data, len, NULL);
+    if(ret) DH_NBT_STAT_ADD(DH_STAT_BYTES_WRITTEN, len);
+    else failed = true;
+    return ret;
+}
+
+bool DhNbtSaveBatch::commit()
+{
+    bool ret = !failed;
+    failed = false;
+    return ret;
+}
+
+void DhNbtSaveBatch::discard()
+{
+    failed = false;
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_SAVE_HPP
+#define NBT_SAVE_HPP
+
+#include <glib.h>
+#include "nbt_compress.hpp"
+
+typedef enum {
+    DH_FSYNC_NONE,  /* Leave it to the OS */
+    DH_FSYNC_DATA,  /* The data is on disk before the rename */
+    DH_FSYNC_FULL   /* And so is the rename, by syncing the directory */
+} DhNbtFsyncPolicy;
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+
+class DhNbtInstance;
+
+/* Crash-safe saving of one or many files. Each file is written to a
+ * temporary file in the same directory and closed, then commit() syncs
+ * them together, once per filesystem on Linux, and renames them over
+ * their targets. New files get the mode open() would give them. */
+class DhNbtSaveBatch
+{
+public:
+  DhNbtSaveBatch(DhNbtFsyncPolicy policy);
+  DhNbtSaveBatch(const DhNbtSaveBatch&) = delete;
+  /* Anything not committed is discarded */
+  ~DhNbtSaveBatch();
+
+  bool add(DhNbtInstance& instance, const char* pos, DhNbtCompression compression);
+  bool add_data(const char* pos, const guint8* data, gsize len);
+  /* Fails if any add() failed, in which case nothing is renamed */
+  bool commit();
+  void discard();
+
+private:
+  struct Pending
+  {
+    std::string temp;
+    std::string target;
+  };
+  std::vector<Pending> pending;
+  DhNbtFsyncPolicy policy;
+  bool failed;
+};
+
+#endif
+
+#endif /* NBT_SAVE_HPP */
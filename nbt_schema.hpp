@@ -0,0 +1,490 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_SCHEMA_HPP
+#define NBT_SCHEMA_HPP
+
+#include "nbt_interface.hpp"
+#include "nbt_codec.hpp"
+#include <array>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/* Compile-time binding of a struct to a compound:
+ *
+ *   struct Metadata { std::string Name; gint32 TotalBlocks; };
+ *   DH_NBT_SCHEMA(Metadata,
+ *       DH_NBT_FIELD(Metadata, Name, "Name"),
+ *       DH_NBT_FIELD(Metadata, TotalBlocks, "TotalBlocks"))
+ *
+ * Field types may be gint8/16/32/64, bool, float, double, std::string,
+ * std::vector<gint8/gint32/gint64> (the array tags), std::vector of any
+ * other supported type (a list) and structs with their own schema.
+ * Keys not in the schema are skipped, missing keys keep their value. */
+
+template<typename S> struct DhNbtSchema;
+
+#define DH_NBT_FIELD(Struct, member, key) dh_nbt_field(key, &Struct::member)
+#define DH_NBT_SCHEMA(Struct, ...) \
+    template<> struct DhNbtSchema<Struct> \
+    { \
+        static constexpr auto fields() { return std::make_tuple(__VA_ARGS__); } \
+    };
+
+/* FNV-1a, the same at compile time and at run time */
+constexpr guint32 dh_nbt_key_hash(const char* key, gsize len)
+{
+    guint32 hash = 2166136261u;
+    for(gsize i = 0 ; i < len ; i++)
+        hash = (hash ^ (guint8)key[i]) * 16777619u;
+    return hash;
+}
+
+constexpr gsize dh_nbt_key_len(const char* key)
+{
+    gsize len = 0;
+    while(key[len]) len++;
+    return len;
+}
+
+template<typename S, typename T>
+struct DhNbtField
+{
+    typedef T value_type;
+    const char* key;
+    gsize len;
+    guint32 hash;
+    T S::* member;
+};
+
+template<typename S, typename T>
+constexpr DhNbtField<S, T> dh_nbt_field(const char* key, T S::* member)
+{
+    return { key, dh_nbt_key_len(key), dh_nbt_key_hash(key, dh_nbt_key_len(key)), member };
+}
+
+/* The hash must be a perfect hash over the keys of a schema,
+ * so a key can only ever match one field */
+template<typename Tuple, gsize... I>
+constexpr bool dh_nbt_hashes_unique(const Tuple& fields, std::index_sequence<I...>)
+{
+    guint32 hashes[] = { std::get<I>(fields).hash..., 0 };
+    for(gsize i = 0 ; i < sizeof...(I) ; i++)
+        for(gsize j = i + 1 ; j < sizeof...(I) ; j++)
+            if(hashes[i] == hashes[j]) return false;
+    return true;
+}
+
+template<typename S>
+constexpr bool dh_nbt_schema_valid()
+{
+    constexpr auto fields = DhNbtSchema<S>::fields();
+    return dh_nbt_hashes_unique(fields, std::make_index_sequence<std::tuple_size<decltype(fields)>::value>());
+}
+
+/* Per-type decode and encode. Each specialization has the tag,
+ * from_node() (NBT node), from_raw() (raw payload) and to_instance(). */
+template<typename T, typename = void> struct DhNbtTraits;
+
+template<typename T, NBT_Tags Tag, int Width>
+struct DhNbtIntegerTraits
+{
+    static constexpr NBT_Tags tag = Tag;
+    static bool from_node(NBT* node, T& out)
+    {
+        if(node->type != Tag) return false;
+        out = (T)node->value_i;
+        return true;
+    }
+    static bool from_raw(const guint8*& pos, const guint8* end, T& out)
+    {
+        guint64 val = 0;
+        if(!dh_nbt_get_be(pos, end, Width, val)) return false;
+        if(Width == 1)      out = (T)(gint8)val;
+        else if(Width == 2) out = (T)(gint16)val;
+        else if(Width == 4) out = (T)(gint32)val;
+        else                out = (T)(gint64)val;
+        return true;
+    }
+};
+
+template<> struct DhNbtTraits<gint8> : DhNbtIntegerTraits<gint8, TAG_Byte, 1>
+{
+    static DhNbtInstance to_instance(gint8 val, const char* key) { return DhNbtInstance(val, key, true); }
+};
+
+template<> struct DhNbtTraits<bool> : DhNbtIntegerTraits<bool, TAG_Byte, 1>
+{
+    static DhNbtInstance to_instance(bool val, const char* key) { return DhNbtInstance((gint8)val, key, true); }
+};
+
+template<> struct DhNbtTraits<gint16> : DhNbtIntegerTraits<gint16, TAG_Short, 2>
+{
+    static DhNbtInstance to_instance(gint16 val, const char* key) { return DhNbtInstance(val, key, true); }
+};
+
+template<> struct DhNbtTraits<gint32> : DhNbtIntegerTraits<gint32, TAG_Int, 4>
+{
+    static DhNbtInstance to_instance(gint32 val, const char* key) { return DhNbtInstance(val, key, true); }
+};
+
+template<> struct DhNbtTraits<gint64> : DhNbtIntegerTraits<gint64, TAG_Long, 8>
+{
+    static DhNbtInstance to_instance(gint64 val, const char* key) { return DhNbtInstance(val, key, true); }
+};
+
+template<> struct DhNbtTraits<float>
+{
+    static constexpr NBT_Tags tag = TAG_Float;
+    static bool from_node(NBT* node, float& out)
+    {
+        if(node->type != TAG_Float) return false;
+        out = node->value_d;
+        return true;
+    }
+    static bool from_raw(const guint8*& pos, const guint8* end, float& out)
+    {
+        guint64 val = 0;
+        if(!dh_nbt_get_be(pos, end, 4, val)) return false;
+        guint32 bits = val;
+        memcpy(&out, &bits, 4);
+        return true;
+    }
+    static DhNbtInstance to_instance(float val, const char* key) { return DhNbtInstance(val, key, true); }
+};
+
+template<> struct DhNbtTraits<double>
+{
+    static constexpr NBT_Tags tag = TAG_Double;
+    static bool from_node(NBT* node, double& out)
+    {
+        if(node->type != TAG_Double) return false;
+        out = node->value_d;
+        return true;
+    }
+    static bool from_raw(const guint8*& pos, const guint8* end, double& out)
+    {
+        guint64 val = 0;
+        if(!dh_nbt_get_be(pos, end, 8, val)) return false;
+        memcpy(&out, &val, 8);
+        return true;
+    }
+    static DhNbtInstance to_instance(double val, const char* key) { return DhNbtInstance(val, key, true); }
+};
+
+template<> struct DhNbtTraits<std::string>
+{
+    static constexpr NBT_Tags tag = TAG_String;
+    static bool from_node(NBT* node, std::string& out)
+    {
+        if(node->type != TAG_String) return false;
+        out = (const char*)node->value_a.value;
+        return true;
+    }
+    static bool from_raw(const guint8*& pos, const guint8* end, std::string& out)
+    {
+        guint64 len = 0;
+        if(!dh_nbt_get_be(pos, end, 2, len) || (guint64)(end - pos) < len) return false;
+        out.assign((const char*)pos, len);
+        pos += len;
+        return true;
+    }
+    static DhNbtInstance to_instance(const std::string& val, const char* key)
+    {
+        return DhNbtInstance(val.c_str(), key, true);
+    }
+};
+
+template<typename T, NBT_Tags Tag>
+struct DhNbtArrayTraits
+{
+    static constexpr NBT_Tags tag = Tag;
+    static bool from_node(NBT* node, std::vector<T>& out)
+    {
+        if(node->type != Tag) return false;
+        const T* arr = (const T*)node->value_a.value;
+        out.assign(arr, arr + node->value_a.len);
+        return true;
+    }
+    static bool from_raw(const guint8*& pos, const guint8* end, std::vector<T>& out)
+    {
+        guint64 len = 0;
+        if(!dh_nbt_get_be(pos, end, 4, len) || (gint32)len < 0
+           || (guint64)(end - pos) < len * sizeof(T))
+            return false;
+        out.resize(len);
+        for(auto& item : out)
+        {
+            guint64 val = 0;
+            dh_nbt_get_be(pos, end, sizeof(T), val);
+            item = (T)val;
+        }
+        return true;
+    }
+    static DhNbtInstance to_instance(const std::vector<T>& val, const char* key)
+    {
+        return DhNbtInstance(val.data(), (int)val.size(), key, true);
+    }
+};
+
+template<> struct DhNbtTraits<std::vector<gint8>> : DhNbtArrayTraits<gint8, TAG_Byte_Array> {};
+template<> struct DhNbtTraits<std::vector<gint32>> : DhNbtArrayTraits<gint32, TAG_Int_Array> {};
+template<> struct DhNbtTraits<std::vector<gint64>> : DhNbtArrayTraits<gint64, TAG_Long_Array> {};
+
+/* Link `nodes` under `parent` in one go, insert_before() would
+ * walk the whole sibling chain for every node */
+inline void dh_nbt_link_children(DhNbtInstance& parent, std::vector<DhNbtInstance>& nodes)
+{
+    NBT* prev = nullptr;
+    for(auto& node : nodes)
+    {
+        NBT* cur = node.get_current_nbt();
+        cur->prev = prev;
+        if(prev) prev->next = cur;
+        prev = cur;
+    }
+    if(!nodes.empty()) parent.prepend(nodes.front());
+}
+
+template<typename T>
+struct DhNbtTraits<std::vector<T>, std::enable_if_t<!std::is_same<T, gint8>::value
+                                                    && !std::is_same<T, gint32>::value
+                                                    && !std::is_same<T, gint64>::value>>
+{
+    static constexpr NBT_Tags tag = TAG_List;
+    static bool from_node(NBT* node, std::vector<T>& out)
+    {
+        if(node->type != TAG_List) return false;
+        out.clear();
+        for(NBT* child = node->child ; child ; child = child->next)
+        {
+            out.emplace_back();
+            if(!DhNbtTraits<T>::from_node(child, out.back())) return false;
+        }
+        return true;
+    }
+    static bool from_raw(const guint8*& pos, const guint8* end, std::vector<T>& out)
+    {
+        guint64 elem_type = 0;
+        guint64 len = 0;
+        if(!dh_nbt_get_be(pos, end, 1, elem_type) || !dh_nbt_get_be(pos, end, 4, len)
+           || (gint32)len < 0)
+            return false;
+        if(len && elem_type != DhNbtTraits<T>::tag) return false;
+        out.clear();
+        for(guint64 i = 0 ; i < len ; i++)
+        {
+            out.emplace_back();
+            if(!DhNbtTraits<T>::from_raw(pos, end, out.back())) return false;
+        }
+        return true;
+    }
+    static DhNbtInstance to_instance(const std::vector<T>& val, const char* key)
+    {
+        DhNbtInstance ret(DH_TYPE_List, key, true);
+        std::vector<DhNbtInstance> nodes;
+        for(auto& item : val)
+            nodes.push_back(DhNbtTraits<T>::to_instance(item, nullptr));
+        dh_nbt_link_children(ret, nodes);
+        return ret;
+    }
+};
+
+/* Entry of the table of a schema sorted by key hash */
+struct DhNbtFieldEntry
+{
+    guint32 hash;
+    const char* key;
+    gsize len;
+    gsize index;
+};
+
+template<typename Tuple, gsize... I>
+constexpr std::array<DhNbtFieldEntry, sizeof...(I)> dh_nbt_sorted_fields(const Tuple& fields, std::index_sequence<I...>)
+{
+    std::array<DhNbtFieldEntry, sizeof...(I)> ret = {{ { std::get<I>(fields).hash, std::get<I>(fields).key,
+                                                         std::get<I>(fields).len, I }... }};
+    /* Insertion sort, done by the compiler */
+    for(gsize i = 1 ; i < ret.size() ; i++)
+        for(gsize j = i ; j > 0 && ret[j - 1].hash > ret[j].hash ; j--)
+        {
+            DhNbtFieldEntry tmp = ret[j];
+            ret[j] = ret[j - 1];
+            ret[j - 1] = tmp;
+        }
+    return ret;
+}
+
+/* Key to field dispatch: a binary search over the hashes sorted at
+ * compile time, then a call through a table of per-field decoders */
+template<typename S, typename = std::make_index_sequence<std::tuple_size<decltype(DhNbtSchema<S>::fields())>::value>>
+struct DhNbtSchemaDispatch;
+
+template<typename S, gsize... I>
+struct DhNbtSchemaDispatch<S, std::index_sequence<I...>>
+{
+    typedef bool (*NodeFunc)(NBT* node, S& out);
+    typedef bool (*RawFunc)(NBT_Tags type, const guint8*& pos, const guint8* end, S& out);
+
+    template<gsize J>
+    static bool from_node(NBT* node, S& out)
+    {
+        constexpr auto field = std::get<J>(DhNbtSchema<S>::fields());
+        return DhNbtTraits<typename std::decay_t<decltype(field)>::value_type>::from_node(node, out.*(field.member));
+    }
+
+    template<gsize J>
+    static bool from_raw(NBT_Tags type, const guint8*& pos, const guint8* end, S& out)
+    {
+        constexpr auto field = std::get<J>(DhNbtSchema<S>::fields());
+        typedef DhNbtTraits<typename std::decay_t<decltype(field)>::value_type> Traits;
+        return type == Traits::tag && Traits::from_raw(pos, end, out.*(field.member));
+    }
+
+    static constexpr std::array<DhNbtFieldEntry, sizeof...(I)> table
+        = dh_nbt_sorted_fields(DhNbtSchema<S>::fields(), std::index_sequence<I...>());
+    static constexpr std::array<NodeFunc, sizeof...(I)> node_funcs = {{ &from_node<I>... }};
+    static constexpr std::array<RawFunc, sizeof...(I)> raw_funcs = {{ &from_raw<I>... }};
+
+    /* Index of the field with this key, -1 if none */
+    static gssize find(const char* key, gsize len)
+    {
+        guint32 hash = dh_nbt_key_hash(key, len);
+        gsize low = 0;
+        gsize high = table.size();
+        while(low < high)
+        {
+            gsize mid = (low + high) / 2;
+            if(table[mid].hash < hash) low = mid + 1;
+            else high = mid;
+        }
+        if(low == table.size() || table[low].hash != hash || table[low].len != len
+           || memcmp(table[low].key, key, len))
+            return -1;
+        return table[low].index;
+    }
+};
+
+template<typename S>
+bool dh_nbt_decode_node(NBT* node, S& out);
+template<typename S>
+bool dh_nbt_decode_payload(const guint8*& pos, const guint8* end, S& out);
+template<typename S>
+DhNbtInstance dh_nbt_encode(const S& in, const char* key, bool temporary_root);
+
+template<typename S>
+struct DhNbtTraits<S, std::void_t<decltype(DhNbtSchema<S>::fields())>>
+{
+    static constexpr NBT_Tags tag = TAG_Compound;
+    static bool from_node(NBT* node, S& out) { return dh_nbt_decode_node(node, out); }
+    static bool from_raw(const guint8*& pos, const guint8* end, S& out)
+    {
+        return dh_nbt_decode_payload(pos, end, out);
+    }
+    static DhNbtInstance to_instance(const S& val, const char* key)
+    {
+        return dh_nbt_encode(val, key, true);
+    }
+};
+
+/* Decode a compound node in one pass over its children */
+template<typename S>
+bool dh_nbt_decode_node(NBT* node, S& out)
+{
+    static_assert(dh_nbt_schema_valid<S>(), "Two keys of the schema share a hash");
+    typedef DhNbtSchemaDispatch<S> Dispatch;
+    if(!node || node->type != TAG_Compound) return false;
+    for(NBT* child = node->child ; child ; child = child->next)
+    {
+        if(!child->key) continue;
+        gssize index = Dispatch::find(child->key, strlen(child->key));
+        if(index >= 0 && !Dispatch::node_funcs[index](child, out)) return false;
+    }
+    return true;
+}
+
+/* Decode a raw compound payload without building any node */
+template<typename S>
+bool dh_nbt_decode_payload(const guint8*& pos, const guint8* end, S& out)
+{
+    static_assert(dh_nbt_schema_valid<S>(), "Two keys of the schema share a hash");
+    typedef DhNbtSchemaDispatch<S> Dispatch;
+    while(true)
+    {
+        guint64 type = 0;
+        guint64 len = 0;
+        if(!dh_nbt_get_be(pos, end, 1, type) || type > TAG_Long_Array) return false;
+        if(type == TAG_End) return true;
+        if(!dh_nbt_get_be(pos, end, 2, len) || (guint64)(end - pos) < len) return false;
+        const char* key = (const char*)pos;
+        pos += len;
+        gssize index = Dispatch::find(key, len);
+        bool ok = index >= 0 ? Dispatch::raw_funcs[index]((NBT_Tags)type, pos, end, out)
+                             : dh_nbt_skip_payload((NBT_Tags)type, pos, end);
+        if(!ok) return false;
+    }
+}
+
+template<typename S>
+DhNbtInstance dh_nbt_encode(const S& in, const char* key, bool temporary_root)
+{
+    constexpr auto fields = DhNbtSchema<S>::fields();
+    DhNbtInstance ret(DH_TYPE_Compound, key, temporary_root);
+    std::vector<DhNbtInstance> nodes;
+    std::apply([&](const auto&... field) {
+        (nodes.push_back(DhNbtTraits<typename std::decay_t<decltype(field)>::value_type>
+                             ::to_instance(in.*(field.member), field.key)), ...);
+    }, fields);
+    dh_nbt_link_children(ret, nodes);
+    return ret;
+}
+
+/* Decode the current node of `instance`, thawing its frozen subtrees
+ * as the decoders read the nodes directly */
+template<typename S>
+bool dh_nbt_decode(DhNbtInstance& instance, S& out)
+{
+    instance.thaw_all();
+    return dh_nbt_decode_node(instance.get_current_nbt(), out);
+}
+
+/* Decode a whole file image, compressed or not, whose root is `S` */
+template<typename S>
+bool dh_nbt_decode_raw(const guint8* data, gsize len, S& out)
+{
+    std::vector<guint8> raw;
+    if(dh_nbt_detect_compression(data, len) != DH_COMPRESSION_NONE)
+    {
+        if(!dh_nbt_decompress(data, len, DH_COMPRESSION_AUTO, raw)) return false;
+        data = raw.data();
+        len = raw.size();
+    }
+    const guint8* pos = data;
+    const guint8* end = data + len;
+    guint64 type = 0;
+    guint64 key_len = 0;
+    if(!dh_nbt_get_be(pos, end, 1, type) || type != TAG_Compound
+       || !dh_nbt_get_be(pos, end, 2, key_len) || (guint64)(end - pos) < key_len)
+        return false;
+    pos += key_len;
+    return dh_nbt_decode_payload(pos, end, out);
+}
+
+#endif /* NBT_SCHEMA_HPP */
@@ -0,0 +1,439 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_interface.hpp"
+#include "nbt_codec.hpp"
+#include "nbt_sidecar.hpp"
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+/* Sidecar layout, native byte order as it never leaves the machine:
+ * header, source path, spans, then the raw NBT. A span is the offset
+ * and length (in the raw NBT) of a named child of the root. */
+#define SIDECAR_MAGIC "DHNBTIDX"
+#define SIDECAR_VERSION 2
+
+struct SidecarHeader
+{
+    char magic[8];
+    guint32 version;
+    guint32 mode;
+    guint64 size;
+    gint64 mtime_us;
+    guint8 hash[32];
+    guint32 path_len;
+    guint32 span_count;
+    guint64 raw_len;
+};
+
+struct SidecarSpan
+{
+    guint64 offset;
+    guint64 len;
+};
+
+/* Below this, parsing on one thread is faster than starting more */
+static const gsize parallel_size = 1 << 20;
+
+static std::atomic<int> sidecar_mode(DH_SIDECAR_OFF);
+static std::atomic<guint64> sidecar_limit(DH_SIDECAR_DEFAULT_LIMIT);
+static std::atomic<guint64> sidecar_hits(0);
+static std::mutex sidecar_lock;
+static std::string sidecar_dir;
+
+/* Only names the sidecar files, the path stored inside is compared */
+static guint64 hash_bytes(const guint8* data, gsize len)
+{
+    /* FNV-1a */
+    guint64 hash = 0xcbf29ce484222325ULL;
+    for(gsize i = 0 ; i < len ; i++)
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+/* The path as stored, padded so the span table stays aligned */
+static std::string padded_path(const char* canonical)
+{
+    std::string ret = canonical;
+    ret.resize((ret.size() + 7) & ~(gsize)7, '\0');
+    return ret;
+}
+
+static std::string sidecar_path(const char* canonical)
+{
+    std::lock_guard<std::mutex> guard(sidecar_lock);
+    gchar* name = g_strdup_printf("%016" G_GINT64_MODIFIER "x.dhidx",
+                                  hash_bytes((const guint8*)canonical, strlen(canonical)));
+    gchar* path = g_build_filename(sidecar_dir.c_str(), name, NULL);
+    std::string ret = path;
+    g_free(name);
+    g_free(path);
+    return ret;
+}
+
+bool dh_nbt_sidecar_key(const char* filename, const guint8* content, gsize len, DhNbtSidecarKey& key)
+{
+    key.mode = (DhNbtSidecarMode)sidecar_mode.load();
+    key.size = 0;
+    key.mtime_us = 0;
+    memset(key.hash, 0, sizeof(key.hash));
+    if(key.mode == DH_SIDECAR_HASH)
+    {
+        if(!content) return false;
+        key.size = len;
+        GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+        g_checksum_update(checksum, content, len);
+        gsize hash_len = sizeof(key.hash);
+        g_checksum_get_digest(checksum, key.hash, &hash_len);
+        g_checksum_free(checksum);
+        return true;
+    }
+    if(key.mode != DH_SIDECAR_STAT) return false;
+
+    GFile* file = g_file_new_for_path(filename);
+    GFileInfo* info = g_file_query_info(file, G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                        G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                        G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                        G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_object_unref(file);
+    if(!info) return false;
+    key.size = g_file_info_get_size(info);
+    key.mtime_us = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+                   + g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+    g_object_unref(info);
+    return true;
+}
+
+/* Parse the spans on several threads and link them under `root` */
+static bool parse_spans(NBT* root, const guint8* raw, gsize raw_len, const SidecarSpan* spans, int count)
+{
+    std::vector<NBT*> children(count, nullptr);
+    std::atomic<int> next(0);
+    auto work = [&]() {
+        for(int i = next++ ; i < count ; i = next++)
+        {
+            const guint8* pos = raw + spans[i].offset;
+            children[i] = dh_nbt_read_node(true, pos, pos + spans[i].len);
+        }
+    };
+    int threads = raw_len < parallel_size ? 1 : MIN((int)g_get_num_processors(), count);
+    std::vector<std::thread> pool;
+    for(int i = 1 ; i < threads ; i++)
+        pool.emplace_back(work);
+    work();
+    for(auto& thread : pool)
+        thread.join();
+
+    bool ok = true;
+    for(NBT* child : children)
+        if(!child) ok = false;
+    if(!ok)
+    {
+        for(NBT* child : children)
+            if(child) dh_nbt_free(child);
+        return false;
+    }
+    for(int i = 0 ; i < count ; i++)
+    {
+        children[i]->prev = i ? children[i - 1] : nullptr;
+        children[i]->next = i + 1 < count ? children[i + 1] : nullptr;
+    }
+    root->child = count ? children[0] : nullptr;
+    return true;
+}
+
+NBT* dh_nbt_sidecar_load(const char* filename, const DhNbtSidecarKey& key)
+{
+    gchar* canonical = g_canonicalize_filename(filename, NULL);
+    std::string path = sidecar_path(canonical);
+    GMappedFile* mapped = g_mapped_file_new(path.c_str(), FALSE, NULL);
+    if(!mapped)
+    {
+        g_free(canonical);
+        return nullptr;
+    }
+
+    const guint8* data = (const guint8*)g_mapped_file_get_contents(mapped);
+    gsize len = g_mapped_file_get_length(mapped);
+    NBT* root = nullptr;
+    SidecarHeader header;
+    std::string stored_path = padded_path(canonical);
+    if(len >= sizeof(header))
+    {
+        memcpy(&header, data, sizeof(header));
+        gsize spans_offset = sizeof(header) + header.path_len;
+        gsize raw_offset = spans_offset + (gsize)header.span_count * sizeof(SidecarSpan);
+        bool valid = memcmp(header.magic, SIDECAR_MAGIC, 8) == 0 && header.version == SIDECAR_VERSION
+                     && header.mode == (guint32)key.mode && header.size == key.size
+                     && header.mtime_us == key.mtime_us && memcmp(header.hash, key.hash, sizeof(key.hash)) == 0
+                     && header.path_len == stored_path.size() && spans_offset <= len
+                     && memcmp(data + sizeof(header), stored_path.data(), stored_path.size()) == 0
+                     && raw_offset <= len && header.raw_len <= len - raw_offset;
+        const guint8* raw = data + raw_offset;
+        const SidecarSpan* spans = (const SidecarSpan*)(data + spans_offset);
+        for(guint32 i = 0 ; valid && i < header.span_count ; i++)
+            if(spans[i].offset > header.raw_len || spans[i].len > header.raw_len - spans[i].offset)
+                valid = false;
+
+        /* The root itself: type and key, then its children */
+        const guint8* pos = raw;
+        guint64 type = 0;
+        guint64 key_len = 0;
+        if(valid && dh_nbt_get_be(pos, raw + header.raw_len, 1, type) && type == TAG_Compound
+           && dh_nbt_get_be(pos, raw + header.raw_len, 2, key_len) && key_len <= header.raw_len - 3)
+        {
+            std::vector<guint8> empty(raw, raw + 3 + key_len);
+            empty.push_back(TAG_End);
+            const guint8* empty_pos = empty.data();
+            root = dh_nbt_read_node(true, empty_pos, empty.data() + empty.size());
+            if(root && !parse_spans(root, raw, header.raw_len, spans, header.span_count))
+            {
+                dh_nbt_free(root);
+                root = nullptr;
+            }
+        }
+        if(root)
+        {
+            DH_NBT_STAT_ADD(DH_STAT_BYTES_READ, len);
+            sidecar_hits++;
+        }
+    }
+    g_mapped_file_unref(mapped);
+    /* The mtime orders the sidecars for eviction */
+    if(root) g_utime(path.c_str(), NULL);
+    g_free(canonical);
+    return root;
+}
+
+/* Spans of the children of the root, false if `raw` is malformed */
+static bool find_spans(const std::vector<guint8>& raw, std::vector<SidecarSpan>& spans)
+{
+    const guint8* start = raw.data();
+    const guint8* pos = start;
+    const guint8* end = start + raw.size();
+    guint64 val = 0;
+    if(!dh_nbt_get_be(pos, end, 1, val) || val != TAG_Compound
+       || !dh_nbt_get_be(pos, end, 2, val) || (guint64)(end - pos) < val)
+        return false;
+    pos += val;
+    while(true)
+    {
+        const guint8* child = pos;
+        guint64 type = 0;
+        if(!dh_nbt_get_be(pos, end, 1, type) || type > TAG_Long_Array) return false;
+        if(type == TAG_End) return true;
+        if(!dh_nbt_get_be(pos, end, 2, val) || (guint64)(end - pos) < val) return false;
+        pos += val;
+        if(!dh_nbt_skip_payload((NBT_Tags)type, pos, end)) return false;
+        spans.push_back({ (guint64)(child - start), (guint64)(pos - child) });
+    }
+}
+
+struct SidecarJob
+{
+    std::string path;
+    std::string stored_path;
+    std::string dir;
+    DhNbtSidecarKey key;
+    std::vector<guint8> raw;
+};
+
+static void write_sidecar(const SidecarJob& job)
+{
+    std::vector<SidecarSpan> spans;
+    if(!find_spans(job.raw, spans)) return;
+    SidecarHeader header;
+    memcpy(header.magic, SIDECAR_MAGIC, 8);
+    header.version = SIDECAR_VERSION;
+    header.mode = job.key.mode;
+    header.size = job.key.size;
+    header.mtime_us = job.key.mtime_us;
+    memcpy(header.hash, job.key.hash, sizeof(header.hash));
+    header.path_len = job.stored_path.size();
+    header.span_count = spans.size();
+    header.raw_len = job.raw.size();
+
+    std::vector<guint8> data((const guint8*)&header, (const guint8*)(&header + 1));
+    data.insert(data.end(), job.stored_path.begin(), job.stored_path.end());
+    data.insert(data.end(), (const guint8*)spans.data(), (const guint8*)(spans.data() + spans.size()));
+    data.insert(data.end(), job.raw.begin(), job.raw.end());
+    DhNbtSaveBatch batch(DH_FSYNC_NONE);
+    if(batch.add_data(job.path.c_str(), data.data(), data.size()))
+        batch.commit();
+}
+
+/* Remove the least recently loaded sidecars of `dir` down to `limit` */
+static void evict_sidecars(const std::string& dir, guint64 limit)
+{
+    struct Entry
+    {
+        std::string path;
+        guint64 size;
+        gint64 mtime;
+    };
+    GDir* handle = g_dir_open(dir.c_str(), 0, NULL);
+    if(!handle) return;
+    std::vector<Entry> entries;
+    guint64 total = 0;
+    while(const gchar* name = g_dir_read_name(handle))
+    {
+        if(!g_str_has_suffix(name, ".dhidx")) continue;
+        gchar* path = g_build_filename(dir.c_str(), name, NULL);
+        GStatBuf st;
+        if(g_stat(path, &st) == 0)
+        {
+            entries.push_back({ path, (guint64)st.st_size, (gint64)st.st_mtime });
+            total += st.st_size;
+        }
+        g_free(path);
+    }
+    g_dir_close(handle);
+    if(total <= limit) return;
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.mtime < b.mtime; });
+    for(auto& entry : entries)
+    {
+        if(total <= limit) break;
+        if(g_unlink(entry.path.c_str()) == 0) total -= entry.size;
+    }
+}
+
+/* The background writer: one thread, started by the first store. It
+ * is destroyed at exit, after finishing what is still queued. */
+struct SidecarWriter
+{
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::deque<SidecarJob> jobs;
+    /* Sidecars queued or being written */
+    std::set<std::string> pending;
+    std::thread thread;
+    bool stopping = false;
+
+    ~SidecarWriter()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        if(thread.joinable()) thread.join();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while(true)
+        {
+            wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+            if(jobs.empty()) return;
+            SidecarJob job = std::move(jobs.front());
+            jobs.pop_front();
+            guard.unlock();
+            write_sidecar(job);
+            guint64 limit = sidecar_limit.load();
+            if(limit) evict_sidecars(job.dir, limit);
+            guard.lock();
+            pending.erase(job.path);
+            done.notify_all();
+        }
+    }
+};
+
+/* Created on first use, so it goes away before the statics of the
+ * other files that writing uses */
+static SidecarWriter& get_writer()
+{
+    static SidecarWriter writer;
+    return writer;
+}
+
+void dh_nbt_sidecar_store(const char* filename, const DhNbtSidecarKey& key, std::vector<guint8>&& raw)
+{
+    if(key.mode == DH_SIDECAR_OFF) return;
+    gchar* canonical = g_canonicalize_filename(filename, NULL);
+    SidecarJob job;
+    job.path = sidecar_path(canonical);
+    job.stored_path = padded_path(canonical);
+    g_free(canonical);
+    {
+        std::lock_guard<std::mutex> guard(sidecar_lock);
+        job.dir = sidecar_dir;
+    }
+    job.key = key;
+    job.raw = std::move(raw);
+
+    SidecarWriter& writer = get_writer();
+    {
+        std::lock_guard<std::mutex> guard(writer.lock);
+        if(writer.stopping || !writer.pending.insert(job.path).second) return;
+        writer.jobs.push_back(std::move(job));
+        if(!writer.thread.joinable())
+            writer.thread = std::thread([&writer]() { writer.run(); });
+    }
+    writer.wake.notify_one();
+}
+
+extern "C"
+{
+    void dh_nbt_sidecar_set_mode(DhNbtSidecarMode mode, const char* dir)
+    {
+        std::lock_guard<std::mutex> guard(sidecar_lock);
+        if(dir) sidecar_dir = dir;
+        else
+        {
+            gchar* path = g_build_filename(g_get_user_cache_dir(), "nbt_interface", NULL);
+            sidecar_dir = path;
+            g_free(path);
+        }
+        if(mode != DH_SIDECAR_OFF)
+            g_mkdir_with_parents(sidecar_dir.c_str(), 0700);
+        sidecar_mode = mode;
+    }
+
+    DhNbtSidecarMode dh_nbt_sidecar_get_mode()
+    {
+        return (DhNbtSidecarMode)sidecar_mode.load();
+    }
+
+    void dh_nbt_sidecar_set_limit(guint64 limit)
+    {
+        sidecar_limit = limit;
+    }
+
+    guint64 dh_nbt_sidecar_hits()
+    {
+        return sidecar_hits.load();
+    }
+
+    void dh_nbt_sidecar_wait()
+    {
+        SidecarWriter& writer = get_writer();
+        std::unique_lock<std::mutex> guard(writer.lock);
+        writer.done.wait(guard, [&writer]() { return writer.pending.empty(); });
+    }
+}
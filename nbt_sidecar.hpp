@@ -0,0 +1,78 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_SIDECAR_HPP
+#define NBT_SIDECAR_HPP
+
+#include <glib.h>
+#include "libnbt/nbt.h"
+
+/* Sidecar cache: the uncompressed NBT of a loaded file is kept in a
+ * cache directory with the span of each child of the root, so that
+ * the next load maps it and parses the children in parallel instead
+ * of decompressing the file. A missing or stale sidecar is rebuilt
+ * in the background after a normal load, and the ones still queued at
+ * exit are written before the process ends.
+ *
+ * The cache directory is kept under a size limit by dropping the least
+ * recently loaded sidecars after each write. Its files can also be
+ * removed at any time, they are only ever a cache. */
+typedef enum {
+    DH_SIDECAR_OFF,   /* Default */
+    DH_SIDECAR_STAT,  /* Valid while the file size and mtime match */
+    DH_SIDECAR_HASH   /* Valid while the file size and SHA-256 match */
+} DhNbtSidecarMode;
+
+/* Default size limit of the cache directory */
+#define DH_SIDECAR_DEFAULT_LIMIT ((guint64)1 << 30)
+
+#ifdef __cplusplus
+#include <vector>
+
+typedef struct DhNbtSidecarKey
+{
+    DhNbtSidecarMode mode;
+    guint64 size;
+    gint64 mtime_us;
+    guint8 hash[32];
+} DhNbtSidecarKey;
+
+/* Key of `filename` in the current mode, the content is needed
+ * (and only read) for DH_SIDECAR_HASH */
+bool dh_nbt_sidecar_key(const char* filename, const guint8* content, gsize len, DhNbtSidecarKey& key);
+/* The tree from a valid sidecar, nullptr otherwise */
+NBT* dh_nbt_sidecar_load(const char* filename, const DhNbtSidecarKey& key);
+/* Write the sidecar of `raw` (uncompressed NBT) in the background */
+void dh_nbt_sidecar_store(const char* filename, const DhNbtSidecarKey& key, std::vector<guint8>&& raw);
+
+extern "C"
+{
+#endif
+  /* `dir` NULL for the user cache directory */
+  void dh_nbt_sidecar_set_mode(DhNbtSidecarMode mode, const char* dir);
+  DhNbtSidecarMode dh_nbt_sidecar_get_mode();
+  /* Bytes the cache directory may hold, 0 for no limit */
+  void dh_nbt_sidecar_set_limit(guint64 limit);
+  /* Wait for the sidecars being written */
+  void dh_nbt_sidecar_wait();
+  /* Loads served from a sidecar since the process started */
+  guint64 dh_nbt_sidecar_hits();
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NBT_SIDECAR_HPP */
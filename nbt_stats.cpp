@@ -0,0 +1,157 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_stats.hpp"
+#include <cstring>
+
+static_assert(sizeof(DhNbtStats) == DH_STAT_COUNT * sizeof(guint64),
+              "DhNbtStats must match DhNbtStatCounter");
+
+#ifdef DH_NBT_STATS
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+/* Each thread only writes its own block, so plain relaxed
+ * load/store is enough; readers may see a slightly stale value */
+struct DhNbtStatBlock
+{
+    std::atomic<guint64> counters[DH_STAT_COUNT];
+    DhNbtStatBlock();
+    ~DhNbtStatBlock();
+};
+
+static std::mutex registry_mutex;
+static std::vector<DhNbtStatBlock*> registry;
+/* Counters of exited threads */
+static guint64 retired[DH_STAT_COUNT];
+/* Totals at the last reset. Only the owning thread writes a block,
+ * as a concurrent store of zero would be lost to its next add. */
+static guint64 baseline[DH_STAT_COUNT];
+
+DhNbtStatBlock::DhNbtStatBlock()
+{
+    for(auto& counter : counters)
+        counter.store(0, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(this);
+}
+
+DhNbtStatBlock::~DhNbtStatBlock()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for(int i = 0 ; i < DH_STAT_COUNT ; i++)
+        retired[i] += counters[i].load(std::memory_order_relaxed);
+    registry.erase(std::find(registry.begin(), registry.end(), this));
+}
+
+void dh_nbt_stat_add(DhNbtStatCounter counter, guint64 val)
+{
+    thread_local DhNbtStatBlock block;
+    auto& slot = block.counters[counter];
+    slot.store(slot.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+}
+
+guint64 dh_nbt_count_nodes(NBT* node)
+{
+    if(!node) return 0;
+    guint64 ret = 1;
+    if(node->type == TAG_List || node->type == TAG_Compound)
+    {
+        for(NBT* child = node->child ; child ; child = child->next)
+            ret += dh_nbt_count_nodes(child);
+    }
+    return ret;
+}
+
+guint64 dh_nbt_free_counted(NBT* node)
+{
+    guint64 ret = 0;
+    while(node)
+    {
+        NBT* next = node->next;
+        if(node->type == TAG_List || node->type == TAG_Compound)
+        {
+            ret += dh_nbt_free_counted(node->child);
+            node->child = nullptr;
+        }
+        node->next = nullptr;
+        NBT_Free(node);
+        ret++;
+        node = next;
+    }
+    return ret;
+}
+
+/* Called with registry_mutex held */
+static void stats_total(guint64* sum)
+{
+    memcpy(sum, retired, sizeof(retired));
+    for(auto block : registry)
+    {
+        for(int i = 0 ; i < DH_STAT_COUNT ; i++)
+            sum[i] += block->counters[i].load(std::memory_order_relaxed);
+    }
+}
+
+DhNbtStats dh_nbt_stats_collect()
+{
+    guint64 sum[DH_STAT_COUNT];
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    stats_total(sum);
+    for(int i = 0 ; i < DH_STAT_COUNT ; i++)
+        sum[i] -= baseline[i];
+    DhNbtStats stats;
+    memcpy(&stats, sum, sizeof(stats));
+    return stats;
+}
+
+static void stats_reset()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    stats_total(baseline);
+}
+
+#else
+
+DhNbtStats dh_nbt_stats_collect()
+{
+    DhNbtStats stats;
+    memset(&stats, 0, sizeof(stats));
+    return stats;
+}
+
+static void stats_reset()
+{
+}
+
+#endif
+
+extern "C"
+{
+    void dh_nbt_stats_get(DhNbtStats* stats)
+    {
+        if(stats) *stats = dh_nbt_stats_collect();
+    }
+
+    void dh_nbt_stats_reset()
+    {
+        stats_reset();
+    }
+}
@@ -0,0 +1,94 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_STATS_HPP
+#define NBT_STATS_HPP
+
+#include <glib.h>
+#include "libnbt/nbt.h"
+
+/* Counters of the interface, enabled by defining DH_NBT_STATS
+ * (the NIMM_ENABLE_STATS CMake option). When it is not defined
+ * every counter macro expands to nothing. */
+
+typedef enum {
+    DH_STAT_NODES_ALLOCATED, DH_STAT_NODES_FREED, DH_STAT_STRDUP_BYTES,
+    DH_STAT_KEY_COMPARISONS, DH_STAT_TREE_PUSHES, DH_STAT_PACK_RETRIES,
+    DH_STAT_BYTES_READ, DH_STAT_BYTES_DECOMPRESSED, DH_STAT_BYTES_WRITTEN,
+    DH_STAT_LOAD_CALLS, DH_STAT_LOAD_TIME_US, DH_STAT_SAVE_CALLS, DH_STAT_SAVE_TIME_US,
+    DH_STAT_COUNT} DhNbtStatCounter;
+
+/* Same order as DhNbtStatCounter */
+typedef struct {
+    guint64 nodes_allocated;
+    guint64 nodes_freed;
+    guint64 strdup_bytes;
+    guint64 key_comparisons;
+    guint64 tree_pushes;
+    guint64 pack_retries;
+    guint64 bytes_read;
+    guint64 bytes_decompressed;
+    guint64 bytes_written;
+    guint64 load_calls;
+    guint64 load_time_us;
+    guint64 save_calls;
+    guint64 save_time_us;
+} DhNbtStats;
+
+#ifdef __cplusplus
+
+#ifdef DH_NBT_STATS
+/* Add to the counter of the calling thread */
+void dh_nbt_stat_add(DhNbtStatCounter counter, guint64 val);
+guint64 dh_nbt_count_nodes(NBT* node);
+/* NBT_Free, returning how many nodes it freed */
+guint64 dh_nbt_free_counted(NBT* node);
+#define DH_NBT_STAT_ADD(counter, val) dh_nbt_stat_add(counter, val)
+#define DH_NBT_STAT_TIME_BEGIN(var) gint64 var = g_get_monotonic_time()
+#define DH_NBT_STAT_TIME_END(counter, var) dh_nbt_stat_add(counter, g_get_monotonic_time() - var)
+#else
+#define DH_NBT_STAT_ADD(counter, val) ((void)0)
+#define DH_NBT_STAT_TIME_BEGIN(var)
+#define DH_NBT_STAT_TIME_END(counter, var) ((void)0)
+#endif
+
+/* NBT_Free that counts the freed nodes */
+inline void dh_nbt_free(NBT* node)
+{
+#ifdef DH_NBT_STATS
+    dh_nbt_stat_add(DH_STAT_NODES_FREED, dh_nbt_free_counted(node));
+#else
+    NBT_Free(node);
+#endif
+}
+
+/* Sum of all threads, including the ones that have exited */
+DhNbtStats dh_nbt_stats_collect();
+
+extern "C"
+{
+#endif
+  /* Both are no-ops (zeroed output) without DH_NBT_STATS. Reset only
+   * moves the baseline the totals are reported from, so it is safe
+   * while other threads are counting. */
+  void dh_nbt_stats_get(DhNbtStats* stats);
+  void dh_nbt_stats_reset();
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NBT_STATS_HPP */
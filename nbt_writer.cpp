@@ -0,0 +1,254 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_writer.hpp"
+#include "nbt_codec.hpp"
+#include <cstring>
+
+/* Uncompressed bytes kept before handing them to the compressor */
+static const gsize flush_size = 1 << 20;
+
+DhNbtWriter::DhNbtWriter(const char* pos, DhNbtCompression compression)
+    : compressor(compression)
+{
+    GFile* file = g_file_new_for_path(pos);
+    stream = G_OUTPUT_STREAM(g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL));
+    g_object_unref(file);
+    own_stream = true;
+    buffer.reserve(flush_size + 64);
+    has_root = false;
+    failed = !stream || !compressor.is_valid();
+    finished = false;
+}
+
+DhNbtWriter::DhNbtWriter(GOutputStream* stream, DhNbtCompression compression)
+    : compressor(compression)
+{
+    this->stream = stream;
+    own_stream = false;
+    buffer.reserve(flush_size + 64);
+    has_root = false;
+    failed = !stream || !compressor.is_valid();
+    finished = false;
+}
+
+DhNbtWriter::~DhNbtWriter()
+{
+    /* Leave the target alone */
+    if(!finished)
+    {
+        failed = true;
+        finish();
+    }
+}
+
+bool DhNbtWriter::fail()
+{
+    failed = true;
+    return false;
+}
+
+bool DhNbtWriter::flush(bool last)
+{
+    compressed.clear();
+    bool ret = compressor.write(buffer.data(), buffer.size(), compressed);
+    if(ret && last) ret = compressor.finish(compressed);
+    buffer.clear();
+    if(ret && !compressed.empty())
+    {
+        ret = g_output_stream_write_all(stream, compressed.data(), compressed.size(), NULL, NULL, NULL);
+        DH_NBT_STAT_ADD(DH_STAT_BYTES_WRITTEN, compressed.size());
+    }
+    return ret || fail();
+}
+
+bool DhNbtWriter::maybe_flush()
+{
+    return buffer.size() < flush_size || flush(false);
+}
+
+/* Type byte and key as needed by the enclosing level */
+bool DhNbtWriter::begin_value(DhNbtType type, const char* key)
+{
+    if(failed || finished) return false;
+    if(levels.empty())
+    {
+#ifndef NDEBUG
+        if(has_root || type != DH_TYPE_Compound) return fail();
+#endif
+        has_root = true;
+        dh_nbt_put_be(buffer, type - 1, 1);
+        if(!dh_nbt_put_string(buffer, key ? key : "")) return fail();
+    }
+    else if(levels.back().is_list)
+    {
+#ifndef NDEBUG
+        if(levels.back().type != type || levels.back().remaining <= 0) return fail();
+#endif
+        levels.back().remaining--;
+    }
+    else
+    {
+#ifndef NDEBUG
+        if(!key) return fail();
+#endif
+        dh_nbt_put_be(buffer, type - 1, 1);
+        if(!dh_nbt_put_string(buffer, key)) return fail();
+    }
+    return true;
+}
+
+bool DhNbtWriter::begin_compound(const char* key)
+{
+    if(!begin_value(DH_TYPE_Compound, key)) return false;
+    levels.push_back({ false, DH_TYPE_Compound, 0 });
+    return maybe_flush();
+}
+
+bool DhNbtWriter::begin_list(DhNbtType type, int count, const char* key)
+{
+#ifndef NDEBUG
+    if(type <= DH_TYPE_End || type > DH_TYPE_Long_Array || count < 0) return fail();
+#endif
+    if(!begin_value(DH_TYPE_List, key)) return false;
+    dh_nbt_put_be(buffer, type - 1, 1);
+    dh_nbt_put_be(buffer, count, 4);
+    levels.push_back({ true, type, count });
+    return maybe_flush();
+}
+
+bool DhNbtWriter::end()
+{
+    if(failed || finished || levels.empty()) return fail();
+#ifndef NDEBUG
+    if(levels.back().is_list && levels.back().remaining != 0) return fail();
+#endif
+    if(!levels.back().is_list)
+        dh_nbt_put_be(buffer, 0, 1);
+    levels.pop_back();
+    return maybe_flush();
+}
+
+bool DhNbtWriter::write_byte(gint8 val, const char* key)
+{
+    if(!begin_value(DH_TYPE_Byte, key)) return false;
+    dh_nbt_put_be(buffer, val, 1);
+    return maybe_flush();
+}
+
+bool DhNbtWriter::write_short(gint16 val, const char* key)
+{
+    if(!begin_value(DH_TYPE_Short, key)) return false;
+    dh_nbt_put_be(buffer, val, 2);
+    return maybe_flush();
+}
+
+bool DhNbtWriter::write_int(gint32 val, const char* key)
+{
+    if(!begin_value(DH_TYPE_Int, key)) return false;
+    dh_nbt_put_be(buffer, val, 4);
+    return maybe_flush();
+}
+
+bool DhNbtWriter::write_long(gint64 val, const char* key)
+{
+    if(!begin_value(DH_TYPE_Long, key)) return false;
+    dh_nbt_put_be(buffer, val, 8);
+    return maybe_flush();
+}
+
+bool DhNbtWriter::write_float(float val, const char* key)
+{
+    if(!begin_value(DH_TYPE_Float, key)) return false;
+    guint32 bits;
+    memcpy(&bits, &val, sizeof(bits));
+    dh_nbt_put_be(buffer, bits, 4);
+    return maybe_flush();
+}
+
+bool DhNbtWriter::write_double(double val, const char* key)
+{
+    if(!begin_value(DH_TYPE_Double, key)) return false;
+    guint64 bits;
+    memcpy(&bits, &val, sizeof(bits));
+    dh_nbt_put_be(buffer, bits, 8);
+    return maybe_flush();
+}
+
+bool DhNbtWriter::write_string(const char* val, const char* key)
+{
+    if(!begin_value(DH_TYPE_String, key)) return false;
+    if(!dh_nbt_put_string(buffer, val)) return fail();
+    return maybe_flush();
+}
+
+/* Arrays may be far larger than the buffer, flush while converting */
+bool DhNbtWriter::write_array(DhNbtType type, const void* val, int len, int width, const char* key)
+{
+    if(len < 0 || !begin_value(type, key)) return false;
+    dh_nbt_put_be(buffer, len, 4);
+    for(int i = 0 ; i < len ; i++)
+    {
+        if(width == 1)
+            dh_nbt_put_be(buffer, ((const gint8*)val)[i], 1);
+        else if(width == 4)
+            dh_nbt_put_be(buffer, ((const gint32*)val)[i], 4);
+        else
+            dh_nbt_put_be(buffer, ((const gint64*)val)[i], 8);
+        if(!maybe_flush()) return false;
+    }
+    return maybe_flush();
+}
+
+bool DhNbtWriter::write_byte_array(const gint8* val, int len, const char* key)
+{
+    return write_array(DH_TYPE_Byte_Array, val, len, sizeof(gint8), key);
+}
+
+bool DhNbtWriter::write_int_array(const gint32* val, int len, const char* key)
+{
+    return write_array(DH_TYPE_Int_Array, val, len, sizeof(gint32), key);
+}
+
+bool DhNbtWriter::write_long_array(const gint64* val, int len, const char* key)
+{
+    return write_array(DH_TYPE_Long_Array, val, len, sizeof(gint64), key);
+}
+
+bool DhNbtWriter::finish()
+{
+    if(finished) return false;
+    finished = true;
+    bool ret = !failed && has_root && levels.empty() && flush(true);
+    if(own_stream && stream)
+    {
+        if(ret)
+            ret = g_output_stream_close(stream, NULL, NULL);
+        else
+        {
+            /* A cancelled close keeps the file it would replace */
+            GCancellable* cancel = g_cancellable_new();
+            g_cancellable_cancel(cancel);
+            g_output_stream_close(stream, cancel, NULL);
+            g_object_unref(cancel);
+        }
+        g_object_unref(stream);
+        stream = nullptr;
+    }
+    if(!ret) failed = true;
+    return ret;
+}
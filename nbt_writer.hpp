@@ -0,0 +1,99 @@
+/*  nbt_interface - NBT Lib Interface
+    Copyright (C) 2025 Dream Helium
+    This file is part of nbtlib_interface.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef NBT_WRITER_HPP
+#define NBT_WRITER_HPP
+
+#include "nbt_interface.hpp"
+#include <gio/gio.h>
+
+/* Push-style encoder writing NBT straight into a compressed stream,
+ * without building any NBT node. Output is flushed every MiB, so memory
+ * stays constant whatever the size of the document. GZIP and ZLIB need
+ * a streaming backend (see DhNbtCompressStream), else the writer is not
+ * valid:
+ *
+ *   DhNbtWriter writer("out.nbt", DH_COMPRESSION_GZIP);
+ *   writer.begin_compound();
+ *   writer.begin_list(DH_TYPE_Int, 2, "pos");
+ *   writer.write_int(1);
+ *   writer.write_int(2);
+ *   writer.end();
+ *   writer.end();
+ *   writer.finish();
+ *
+ * Keys are needed inside a compound and ignored inside a list. Strings
+ * and keys longer than 65535 bytes fail the call and finish(). In debug
+ * builds misuse (wrong type or count in a list, end() without begin,
+ * a missing key, a second root) fails the call and finish(). */
+class DhNbtWriter
+{
+public:
+  /* The file is replaced only when finish() succeeds */
+  DhNbtWriter(const char* pos, DhNbtCompression compression);
+  /* `stream` is neither closed nor unreffed */
+  DhNbtWriter(GOutputStream* stream, DhNbtCompression compression);
+  DhNbtWriter(const DhNbtWriter&) = delete;
+  ~DhNbtWriter();
+
+  bool is_valid() { return !failed; }
+
+  bool begin_compound(const char* key = nullptr);
+  /* `count` elements of `type` have to follow before end() */
+  bool begin_list(DhNbtType type, int count, const char* key = nullptr);
+  bool end();
+
+  bool write_byte(gint8 val, const char* key = nullptr);
+  bool write_short(gint16 val, const char* key = nullptr);
+  bool write_int(gint32 val, const char* key = nullptr);
+  bool write_long(gint64 val, const char* key = nullptr);
+  bool write_float(float val, const char* key = nullptr);
+  bool write_double(double val, const char* key = nullptr);
+  bool write_string(const char* val, const char* key = nullptr);
+  bool write_byte_array(const gint8* val, int len, const char* key = nullptr);
+  bool write_int_array(const gint32* val, int len, const char* key = nullptr);
+  bool write_long_array(const gint64* val, int len, const char* key = nullptr);
+
+  /* Flush and close; fails if the document is incomplete */
+  bool finish();
+
+private:
+  struct Level
+  {
+    bool is_list;
+    DhNbtType type;
+    int remaining;
+  };
+
+  bool begin_value(DhNbtType type, const char* key);
+  bool write_array(DhNbtType type, const void* val, int len, int width, const char* key);
+  bool fail();
+  bool flush(bool last);
+  bool maybe_flush();
+
+  GOutputStream* stream;
+  bool own_stream;
+  DhNbtCompressStream compressor;
+  std::vector<guint8> buffer;
+  std::vector<guint8> compressed;
+  std::vector<Level> levels;
+  bool has_root;
+  bool failed;
+  bool finished;
+};
+
+#endif /* NBT_WRITER_HPP */
@@ -1,5 +1,36 @@
 #include "nbt_interface.hpp"
+#include "nbt_diff.hpp"
+#include "nbt_schema.hpp"
+#include "nbt_writer.hpp"
+#include "nbt_block_index.hpp"
+#include "nbt_parallel.hpp"
+#include "nbt_codec.hpp"
 #include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+struct Entry
+{
+    gint8 key = 0;
+    std::string name;
+    std::vector<gint32> pos;
+};
+
+DH_NBT_SCHEMA(Entry,
+    DH_NBT_FIELD(Entry, key, "key"),
+    DH_NBT_FIELD(Entry, name, "name"),
+    DH_NBT_FIELD(Entry, pos, "pos"))
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        std::cout << "FAILED: " << what << "\n";
+        failures++;
+    }
+}
 
 static const char* get_value(const char* val)
 {
@@ -27,5 +58,450 @@ int main()
     std::cout << root.child() << "\n";
     std::cout << root.get_key() << "\n";
 
-    return 0;
+    root.goto_root();
+    DhNbtInstance edited = root.dup_current_as_original(false);
+    edited.child("key");
+    edited.get_current_nbt()->value_i = 20;
+    edited.goto_root();
+    DhNbtPatch patch = DhNbtPatch::diff(root, edited);
+    auto data = patch.serialize();
+    check(DhNbtPatch::deserialize(data.data(), data.size()).apply(root), "patch applied");
+    check(root.child("key") && root.get_byte() == 20, "patched value");
+
+    /* Diff and apply below the root */
+    DhNbtInstance tree(DH_TYPE_Compound, NULL, false);
+    DhNbtInstance inner(DH_TYPE_Compound, "inner", true);
+    inner.prepend(DhNbtInstance((gint32)1, "a", true));
+    tree.prepend(inner);
+    DhNbtInstance tree_copy = tree.dup_current_as_original(false);
+    DhNbtInstance from(tree);
+    from.child("inner");
+    DhNbtInstance to(tree_copy);
+    to.child("inner");
+    to.child("a");
+    to.set_integer(2);
+    to.parent();
+    check(DhNbtPatch::diff(from, to).apply(from), "apply below the root");
+    check(DhNbtPatch::diff(tree, tree_copy).is_empty(), "patched subtree matches");
+    DhNbtInstance replacement((gint32)3, "other", false);
+    check(DhNbtPatch::diff(from, replacement).apply(from), "replace the base node");
+    DhNbtInstance replaced(tree);
+    check(replaced.child("inner") && replaced.is_type(DH_TYPE_Int) && replaced.get_int() == 3,
+          "base node replaced in place");
+
+    /* A failing op leaves the tree as it was */
+    DhNbtInstance atomic(DH_TYPE_Compound, NULL, false);
+    atomic.prepend(DhNbtInstance((gint32)1, "a", true));
+    DhNbtInstance atomic_copy = atomic.dup_current_as_original(false);
+    DhNbtInstance atomic_to = atomic.dup_current_as_original(false);
+    atomic_to.child("a");
+    atomic_to.set_integer(2);
+    atomic_to.parent();
+    atomic_to.prepend(DhNbtInstance((gint32)3, "b", true));
+    auto half = DhNbtPatch::diff(atomic, atomic_to).serialize();
+    half[sizeof("DHNP")]++;
+    half.insert(half.end(), { DH_PATCH_REMOVE, 1, 0, 0, 2, 'z', 'z' });
+    check(!DhNbtPatch::deserialize(half.data(), half.size()).apply(atomic), "patch with a bad path fails");
+    check(DhNbtPatch::diff(atomic, atomic_copy).is_empty(), "failed patch rolled back");
+    std::vector<guint8> trailing = { 'D', 'H', 'N', 'P', 1, 1, DH_PATCH_SET, 1, 0, 0, 1, 'a',
+                                     6, TAG_Int, 0, 0, 0, 7, 0xff };
+    check(!DhNbtPatch::deserialize(trailing.data(), trailing.size()).apply(atomic), "value with trailing bytes rejected");
+    trailing.pop_back();
+    trailing[12] = 5;
+    check(DhNbtPatch::deserialize(trailing.data(), trailing.size()).apply(atomic)
+          && atomic.child("a") && atomic.get_int() == 7, "exact value applied");
+
+    /* Hostile input */
+    std::vector<guint8> huge_list = { TAG_List, 0, 0, TAG_End, 0x7f, 0xff, 0xff, 0xff };
+    const guint8* pos = huge_list.data();
+    check(!dh_nbt_read_node(true, pos, pos + huge_list.size()), "list of TAG_End rejected");
+    auto nested = [](int depth) {
+        std::vector<guint8> data = { TAG_List, 0, 0 };
+        for(int i = 0 ; i < depth ; i++)
+            data.insert(data.end(), { TAG_List, 0, 0, 0, 1 });
+        data.insert(data.end(), { TAG_End, 0, 0, 0, 0 });
+        return data;
+    };
+    std::vector<guint8> deep = nested(DH_NBT_MAX_DEPTH + 10);
+    pos = deep.data();
+    check(!dh_nbt_read_node(true, pos, pos + deep.size()), "deep nesting rejected");
+    pos = deep.data() + 3;
+    check(!dh_nbt_skip_payload(TAG_List, pos, deep.data() + deep.size()), "deep nesting skipped");
+    std::vector<guint8> shallow = nested(100);
+    pos = shallow.data();
+    NBT* shallow_node = dh_nbt_read_node(true, pos, pos + shallow.size());
+    check(shallow_node != nullptr, "moderate nesting accepted");
+    if(shallow_node) dh_nbt_free(shallow_node);
+    if(dh_nbt_compression_available(DH_COMPRESSION_ZSTD))
+    {
+        std::vector<guint8> frames, frame, plain;
+        const guint8 part[] = "frame";
+        for(int i = 0 ; i < 2 ; i++)
+        {
+            dh_nbt_compress(part, 5, DH_COMPRESSION_ZSTD, frame);
+            frames.insert(frames.end(), frame.begin(), frame.end());
+        }
+        check(dh_nbt_decompress(frames.data(), frames.size(), DH_COMPRESSION_ZSTD, plain)
+              && plain.size() == 10, "multi-frame zstd");
+        frames.pop_back();
+        check(!dh_nbt_decompress(frames.data(), frames.size(), DH_COMPRESSION_ZSTD, plain),
+              "truncated zstd rejected");
+    }
+
+    /* Every format through the codec and through load */
+    {
+        DhNbtInstance sample(DH_TYPE_Compound, NULL, false);
+        sample.insert_before(DhNbtInstance(), DhNbtInstance((gint32)42, "answer", true));
+        sample.insert_before(DhNbtInstance(), DhNbtInstance("some text to compress", "text", true));
+        std::vector<guint8> plain;
+        sample.pack(plain, DH_COMPRESSION_NONE);
+        auto loads = [](const std::vector<guint8>& data) {
+            g_file_set_contents("format_test.nbt", (const char*)data.data(), data.size(), NULL);
+            DhNbtInstance loaded("format_test.nbt");
+            bool ret = loaded.child("answer") && loaded.get_int() == 42;
+            remove("format_test.nbt");
+            return ret;
+        };
+        check(dh_nbt_detect_compression(plain.data(), plain.size()) == DH_COMPRESSION_NONE && loads(plain),
+              "uncompressed detected and loaded");
+
+        const struct { DhNbtCompression type; const char* name; } formats[] = {
+            { DH_COMPRESSION_GZIP, "gzip" }, { DH_COMPRESSION_ZLIB, "zlib" }, { DH_COMPRESSION_ZSTD, "zstd" } };
+        for(auto& format : formats)
+        {
+            if(!dh_nbt_compression_available(format.type)) continue;
+            std::vector<guint8> packed, unpacked;
+            std::string what = std::string(format.name) + " round trip";
+            check(dh_nbt_compress(plain.data(), plain.size(), format.type, packed)
+                  && dh_nbt_decompress(packed.data(), packed.size(), format.type, unpacked)
+                  && unpacked == plain, what.c_str());
+            what = std::string(format.name) + " detected and loaded";
+            check(dh_nbt_detect_compression(packed.data(), packed.size()) == format.type
+                  && dh_nbt_decompress(packed.data(), packed.size(), DH_COMPRESSION_AUTO, unpacked)
+                  && unpacked == plain && loads(packed), what.c_str());
+        }
+
+        if(dh_nbt_compression_available(DH_COMPRESSION_GZIP))
+        {
+            std::vector<guint8> members, member, unpacked;
+            gsize half = plain.size() / 2;
+            dh_nbt_compress(plain.data(), half, DH_COMPRESSION_GZIP, members);
+            dh_nbt_compress(plain.data() + half, plain.size() - half, DH_COMPRESSION_GZIP, member);
+            members.insert(members.end(), member.begin(), member.end());
+            check(dh_nbt_decompress(members.data(), members.size(), DH_COMPRESSION_AUTO, unpacked)
+                  && unpacked == plain && loads(members), "multi-member gzip loaded");
+        }
+    }
+
+    /* C API arguments */
+    void* c_array = dh_nbt_instance_cpp_new_type(DH_TYPE_Int_Array, "array", TRUE);
+    gint64 c_out[2];
+    check(dh_nbt_instance_cpp_list_get_integers(c_array, c_out, -1) == -1
+          && dh_nbt_instance_cpp_list_get_integers(c_array, NULL, 2) == -1
+          && dh_nbt_instance_cpp_list_get_integers(c_array, NULL, 0) == 0, "list getter capacity");
+    check(!dh_nbt_instance_cpp_get_int_array(c_array, NULL), "array getter without len");
+    dh_nbt_instance_cpp_free(c_array);
+    void* c_compound = dh_nbt_instance_cpp_new_type(DH_TYPE_Compound, NULL, TRUE);
+    const char* c_keys[] = { "a", NULL };
+    gboolean c_found[2];
+    void* c_children[2];
+    DhNbtFlatNode* c_nodes = NULL;
+    gsize c_n_nodes = 0;
+    guint8* c_pool = NULL;
+    check(dh_nbt_instance_cpp_get_integers(c_compound, c_keys, 2, c_out, c_found) == -1
+          && dh_nbt_instance_cpp_get_children(c_compound, c_keys, 2, c_children) == -1
+          && dh_nbt_instance_cpp_get_integers(c_compound, c_keys, 1, c_out, c_found) == 0, "NULL keys rejected");
+    check(!dh_nbt_instance_cpp_flatten(c_compound, &c_nodes, &c_n_nodes, &c_pool, NULL), "flatten needs pool_len");
+    dh_nbt_instance_cpp_free(c_compound);
+
+    root.goto_root();
+    Entry entry;
+    check(dh_nbt_decode(root, entry) && entry.key == 20, "schema decode");
+    entry.name = "stone";
+    entry.pos = { 1, 2, 3 };
+    DhNbtInstance encoded = dh_nbt_encode(entry, NULL, false);
+    std::vector<guint8> raw;
+    encoded.pack(raw, DH_COMPRESSION_NONE);
+    Entry decoded;
+    check(dh_nbt_decode_raw(raw.data(), raw.size(), decoded) && decoded.key == 20
+          && decoded.name == "stone" && decoded.pos == entry.pos, "schema raw decode");
+
+    {
+        DhNbtWriter writer("writer_test.nbt", DH_COMPRESSION_NONE);
+        writer.begin_compound();
+        writer.begin_list(DH_TYPE_Int, 2, "pos");
+        writer.write_int(4);
+        writer.write_int(5);
+        writer.end();
+        writer.end();
+        check(writer.finish(), "writer finished");
+    }
+    DhNbtInstance written("writer_test.nbt");
+    check(written.child("pos") && written.child(1) && written.get_int() == 5, "written document read back");
+    remove("writer_test.nbt");
+    {
+        DhNbtWriter writer("writer_long_test.nbt", DH_COMPRESSION_NONE);
+        writer.begin_compound();
+        check(!writer.write_string(std::string(0x10000, 'a').c_str(), "long"), "writer rejects long string");
+        check(!writer.finish(), "writer fails after long string");
+    }
+    remove("writer_long_test.nbt");
+
+    {
+        DhNbtWriter writer("index_test.nbt", DH_COMPRESSION_NONE);
+        writer.begin_compound();
+        writer.begin_list(DH_TYPE_Compound, 1, "palette");
+        writer.begin_compound();
+        writer.write_string("minecraft:stone", "Name");
+        writer.end();
+        writer.end();
+        writer.begin_list(DH_TYPE_Compound, 1, "blocks");
+        writer.begin_compound();
+        writer.write_int(0, "state");
+        gint32 block_pos[3] = { 1, 2, 3 };
+        writer.begin_list(DH_TYPE_Int, 3, "pos");
+        for(gint32 val : block_pos)
+            writer.write_int(val);
+        writer.end();
+        writer.end();
+        writer.end();
+        writer.end();
+        writer.finish();
+    }
+    DhNbtInstance structure("index_test.nbt");
+    DhNbtBlockIndex index;
+    check(index.build(structure), "structure index built");
+    const DhNbtBlockState* indexed = index.get_block(1, 2, 3);
+    check(indexed && indexed->name == "minecraft:stone" && index.get_state(0, 0, 0) < 0, "structure block indexed");
+    check(dh_nbt_map_reduce(structure, (gint64)0,
+                            [](NBT*, gint64& acc) { acc++; },
+                            [](gint64& total, gint64& acc) { total += acc; }, 4) == 11, "map_reduce visits every node");
+    bool thrown = false;
+    try
+    {
+        dh_nbt_map_reduce(structure, (gint64)0,
+                          [](NBT* node, gint64&) { if(node->type == TAG_String) throw std::runtime_error("map"); },
+                          [](gint64&, gint64&) {}, 4);
+    }
+    catch(const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    check(thrown, "map_reduce rethrows on the caller");
+
+    /* Cold subtrees */
+    {
+        std::vector<guint8> before;
+        std::vector<guint8> after;
+        structure.pack(before, DH_COMPRESSION_NONE);
+        DhNbtInstance unfrozen = structure.dup_current_as_original(false);
+        DhNbtInstance frozen(structure);
+        frozen.child("blocks");
+        int blocks = frozen.child_value();
+        check(frozen.freeze(DH_COMPRESSION_NONE) && frozen.is_frozen()
+              && structure.get_freeze_stats().frozen == 1, "subtree frozen");
+        structure.pack(after, DH_COMPRESSION_NONE);
+        check(before == after, "pack goes through the blob");
+        check(DhNbtPatch::diff(unfrozen, structure).is_empty(), "diff goes through the blob");
+        check(frozen.dup_current_as_original(false).child_value() == blocks && frozen.is_frozen(),
+              "copy of a frozen subtree");
+        check(frozen.child_value() == blocks && !frozen.is_frozen(), "child() thaws");
+
+        structure.set_freeze_budget(1);
+        check(frozen.freeze(DH_COMPRESSION_NONE) && dh_nbt_map_reduce(frozen, (gint64)0,
+              [](NBT*, gint64& acc) { acc++; }, [](gint64& total, gint64& acc) { total += acc; }, 2) > blocks
+              && structure.get_freeze_stats().thawed == 1, "map_reduce thaws");
+        check(structure.collect_frozen() == 1 && frozen.is_frozen(), "collected under the budget");
+        check(DhNbtBlockIndex().build(structure) && !frozen.is_frozen(), "index build thaws");
+        check(frozen.freeze(DH_COMPRESSION_NONE) && structure.thaw_all() == 1 && frozen.child(0)
+              && frozen.child("state"), "thawed from the root");
+
+        DhNbtInstance temp(DH_TYPE_Compound, "temp", true);
+        temp.insert_before(DhNbtInstance(), DhNbtInstance(1, "a", true));
+        check(!temp.freeze(DH_COMPRESSION_NONE), "temporary roots do not freeze");
+    }
+
+    /* Index updates */
+    {
+        DhNbtWriter writer("index_edit_test.nbt", DH_COMPRESSION_NONE);
+        writer.begin_compound();
+        writer.begin_list(DH_TYPE_Compound, 1, "palette");
+        writer.begin_compound();
+        writer.write_string("minecraft:chest", "Name");
+        writer.end();
+        writer.end();
+        writer.begin_list(DH_TYPE_Compound, 2, "blocks");
+        for(int i = 0 ; i < 2 ; i++)
+        {
+            writer.begin_compound();
+            writer.write_int(0, "state");
+            writer.begin_list(DH_TYPE_Int, 3, "pos");
+            for(int axis = 0 ; axis < 3 ; axis++)
+                writer.write_int(i * 4);
+            writer.end();
+            writer.begin_compound("nbt");
+            writer.write_string("minecraft:chest", "id");
+            writer.end();
+            writer.end();
+        }
+        writer.end();
+        writer.end();
+        writer.finish();
+    }
+    DhNbtInstance edit_tree("index_edit_test.nbt");
+    DhNbtBlockIndex edit_index;
+    check(edit_index.build(edit_tree), "index built");
+    DhNbtInstance entity;
+    check(edit_index.get_block_entity(4, 4, 4, entity) && entity.parent() && entity.child("state"),
+          "block entity cursor leads back to its block");
+    entity.parent();
+    check(entity.parent() && entity.is_type(DH_TYPE_List) && entity.parent() && !entity.parent(),
+          "block entity cursor has its parents");
+    DhNbtInstance moved(edit_tree);
+    moved.child("blocks");
+    moved.child(1);
+    moved.child("pos");
+    moved.child(0);
+    moved.set_integer(6);
+    moved.parent();
+    moved.parent();
+    check(edit_index.update_block(moved), "moved block updated");
+    check(edit_index.get_state(4, 4, 4) < 0 && !edit_index.get_block_entity(4, 4, 4, entity),
+          "old position cleared");
+    check(edit_index.get_state(6, 4, 4) == 0 && edit_index.get_block_entity(6, 4, 4, entity),
+          "new position set");
+    int box_min[3], box_max[3];
+    edit_index.set_block(6, 4, 4, -1);
+    check(edit_index.get_bounds(box_min, box_max) && box_max[0] == 0 && box_max[1] == 0,
+          "bounds shrink after a removal");
+    DhNbtInstance first(edit_tree);
+    first.child("blocks");
+    first.child(0);
+    check(edit_index.remove_block(first) && edit_index.get_state(0, 0, 0) < 0
+          && !edit_index.get_block_entity(0, 0, 0, entity), "removed block cleared");
+    check(!edit_index.remove_block(first), "removed block forgotten");
+    check(!edit_index.set_block(1 << 20, 0, 0, 0) && edit_index.set_block(-(1 << 20), 0, 0, 0)
+          && edit_index.get_state(-(1 << 20), 0, 0) == 0 && edit_index.get_state(1 << 20, 0, 0) < 0,
+          "coordinate range");
+    remove("index_edit_test.nbt");
+
+    {
+        DhNbtWriter writer("index_region_test.litematic", DH_COMPRESSION_NONE);
+        writer.begin_compound();
+        writer.begin_compound("Regions");
+        const char* names[2] = { "A", "B" };
+        const char* blocks[2] = { "minecraft:stone", "minecraft:dirt" };
+        for(int i = 0 ; i < 2 ; i++)
+        {
+            /* A covers x 0..1, B after it only x 1 */
+            writer.begin_compound(names[i]);
+            writer.begin_compound("Position");
+            writer.write_int(i, "x");
+            writer.write_int(0, "y");
+            writer.write_int(0, "z");
+            writer.end();
+            writer.begin_compound("Size");
+            writer.write_int(2 - i, "x");
+            writer.write_int(1, "y");
+            writer.write_int(1, "z");
+            writer.end();
+            writer.begin_list(DH_TYPE_Compound, 1, "BlockStatePalette");
+            writer.begin_compound();
+            writer.write_string(blocks[i], "Name");
+            writer.end();
+            writer.end();
+            gint64 states = 0;
+            writer.write_long_array(&states, 1, "BlockStates");
+            writer.end();
+        }
+        writer.end();
+        writer.end();
+        writer.finish();
+    }
+    DhNbtInstance litematic("index_region_test.litematic");
+    DhNbtBlockIndex region_index;
+    check(region_index.build(litematic) && region_index.get_block(1, 0, 0)->name == "minecraft:dirt",
+          "later region wins");
+    check(region_index.update_region("A") && region_index.get_block(1, 0, 0)->name == "minecraft:dirt"
+          && region_index.get_block(0, 0, 0)->name == "minecraft:stone", "update keeps region order");
+    litematic.child("Regions");
+    litematic.rm_node("A");
+    check(region_index.update_region("A") && region_index.get_state(0, 0, 0) < 0
+          && region_index.get_block(1, 0, 0)->name == "minecraft:dirt", "removed region cleared");
+    check(region_index.get_bounds(box_min, box_max) && box_min[0] == 1 && box_max[0] == 1,
+          "bounds shrink after a region removal");
+    remove("index_region_test.litematic");
+
+    dh_nbt_sidecar_set_mode(DH_SIDECAR_HASH, NULL);
+    DhNbtInstance uncached("index_test.nbt");
+    dh_nbt_sidecar_wait();
+    guint64 hits = dh_nbt_sidecar_hits();
+    DhNbtInstance cached("index_test.nbt");
+    check(dh_nbt_sidecar_hits() == hits + 1, "second load served from the sidecar");
+    check(cached.child("blocks") && cached.child(0) && cached.child("state") && cached.get_int() == 0,
+          "sidecar load content");
+    dh_nbt_sidecar_set_mode(DH_SIDECAR_OFF, NULL);
+    remove("index_test.nbt");
+
+#ifdef DH_NBT_STATS
+    {
+        DhNbtInstance counted(DH_TYPE_Compound, NULL, false);
+        counted.insert_before(DhNbtInstance(), DhNbtInstance((gint32)1, "a", true));
+        counted.insert_before(DhNbtInstance(), DhNbtInstance("text", "b", true));
+        std::vector<guint8> plain, packed;
+        counted.pack(plain, DH_COMPRESSION_NONE);
+        counted.pack(packed, DH_COMPRESSION_GZIP);
+        g_file_set_contents("stats_test.nbt", (const char*)packed.data(), packed.size(), NULL);
+
+        DhNbtStats stats, zero = {};
+        dh_nbt_stats_reset();
+        dh_nbt_stats_get(&stats);
+        check(!memcmp(&stats, &zero, sizeof(stats)), "stats reset");
+        {
+            DhNbtInstance loaded("stats_test.nbt");
+            dh_nbt_stats_get(&stats);
+            check(stats.nodes_allocated == 3 && stats.load_calls == 1 && stats.bytes_read == packed.size()
+                  && stats.bytes_decompressed == plain.size(), "load counted");
+        }
+        dh_nbt_stats_get(&stats);
+        check(stats.nodes_freed == 3, "free counted");
+        dh_nbt_stats_reset();
+        dh_nbt_stats_get(&stats);
+        check(!memcmp(&stats, &zero, sizeof(stats)), "stats back to zero");
+        remove("stats_test.nbt");
+    }
+#endif
+
+    /* Atomic saves */
+    {
+        const char long_data[] = "the previous, longer content";
+        const char short_data[] = "new";
+        g_file_set_contents("save_test.bin", long_data, sizeof(long_data) - 1, NULL);
+        DhNbtSaveBatch failing(DH_FSYNC_DATA);
+        failing.add_data("save_test.bin", (const guint8*)short_data, sizeof(short_data) - 1);
+        failing.add_data("missing_dir/save_test.bin", (const guint8*)short_data, sizeof(short_data) - 1);
+        gchar* contents = NULL;
+        gsize len = 0;
+        check(!failing.commit() && g_file_get_contents("save_test.bin", &contents, &len, NULL)
+              && std::string(contents, len) == long_data, "failed save leaves the old file");
+        g_free(contents);
+
+        DhNbtSaveBatch batch(DH_FSYNC_FULL);
+        check(batch.add_data("save_test.bin", (const guint8*)short_data, sizeof(short_data) - 1)
+              && batch.add_data("save_new_test.bin", (const guint8*)short_data, sizeof(short_data) - 1)
+              && batch.commit(), "batch saved");
+        contents = NULL;
+        check(g_file_get_contents("save_test.bin", &contents, &len, NULL)
+              && std::string(contents, len) == short_data, "save replaces a longer file");
+        g_free(contents);
+        mode_t mask = umask(0);
+        umask(mask);
+        struct stat st;
+        check(stat("save_new_test.bin", &st) == 0 && (st.st_mode & 0777) == (0666 & ~mask),
+              "new file follows the umask");
+        remove("save_test.bin");
+        remove("save_new_test.bin");
+    }
+
+    return failures ? 1 : 0;
 }
\ No newline at end of file